@@ -7,4 +7,4 @@ input_path="input/"
 mkdir -p input output
 
 # Create default parameters file
-printf "seed: 0\nsample rounds: 100\nfrustration rounds: 100000\ntrain: 1\ntraining rounds: 1000000\ntraining interval: 1500\nmonitor: 1\nmonitoring rounds: 1000\npresenters sets: 10\nmax nu: 0.2\nactivation threshold percent: 5\n" > $input_path"parameters.txt"
+printf "seed: 0\nsample rounds: 100\nfrustration rounds: 100000\ntrain: 1\ntraining rounds: 1000000\ntraining interval: 1500\nmonitor: 1\nmonitoring rounds: 1000\npresenters sets: 10\nmax nu: 0.2\nactivation threshold percent: 5\ncalibration error: 0\ncalibration confidence: 95\ncalibration batch: 32\nprune detectors: 0\nprune auc tolerance percent: 1\nonline calibration: 0\nonline seed samples: 100\nonline batch: 32\nonline half life: 0\nresponse cache size: 0\nresponse cache quantize: 0\nscoring processes: 1\nthreads: 1\nround threads: 1\nfast shuffle: 0\npipeline samples: 0\nmetrics interval ms: 0\ntau cap: 0\nmemory report: 0\ntrace: 0\ntrace rounds: 0\ntrace compress: 0\n" > $input_path"parameters.txt"
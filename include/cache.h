@@ -0,0 +1,220 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "signatures.h"
+#include <cerrno>           // errno, ERANGE
+#include <cstdlib>          // strtoull
+#include <list>             // list
+#include <unordered_map>    // unordered_map
+
+namespace cfm
+{
+
+    // Bounded least recently used cache of collective responses
+    struct ResponseCache
+    {
+        // Maximum number of cached responses (0 disables the cache)
+        uint32_t capacity = 0;
+
+        // Fingerprint of the model the cached responses were computed with
+        uint64_t model_fingerprint = 0;
+
+        // Quantize samples to the detectors' critical intervals before hashing
+        bool quantize = false;
+
+        // Breakpoint index used for quantization
+        SignatureIndex signature_index;
+
+        // Cached keys and responses (front = most recently used)
+        std::list<std::pair<uint64_t, uint32_t>> entries;
+
+        // Position of each key in the entries list
+        std::unordered_map<uint64_t, std::list<std::pair<uint64_t, uint32_t>>::iterator> index;
+    };
+
+    // Hash raw bytes into a running FNV-1a hash
+    uint64_t hashBytes(uint64_t hash, void const* data, std::size_t size)
+    {
+        unsigned char const* bytes = static_cast<unsigned char const*>(data);
+        for (std::size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    // Hash a vector's values into a running hash
+    template<class T>
+    uint64_t hashVector(uint64_t hash, const std::vector<T>& vector_data)
+    {
+        uint64_t size = vector_data.size();
+        hash = hashBytes(hash, &size, sizeof(size));
+        if (!vector_data.empty()) {
+            hash = hashBytes(hash, vector_data.data(), vector_data.size() * sizeof(T));
+        }
+
+        return hash;
+    }
+
+    // Fingerprint everything that determines a trained model's response to a sample, including the simulation settings
+    uint64_t computeModelFingerprint(Agents const& agents, uint16_t const& n_presenters, uint16_t const& activation_tau, uint32_t const& monitoring_rounds, bool const& fast_shuffle, uint16_t const& seed = 0)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+
+        hash = hashBytes(hash, &n_presenters, sizeof(n_presenters));
+        hash = hashBytes(hash, &activation_tau, sizeof(activation_tau));
+        hash = hashBytes(hash, &monitoring_rounds, sizeof(monitoring_rounds));
+        hash = hashBytes(hash, &seed, sizeof(seed));
+        hash = hashBytes(hash, &agents.tau_cap, sizeof(agents.tau_cap));
+        hash = hashBytes(hash, &fast_shuffle, sizeof(fast_shuffle));
+
+        for (uint16_t i = n_presenters; i < agents.id.size(); ++i) {
+            hash = hashBytes(hash, &agents.subtype.at(i), sizeof(agents.subtype.at(i)));
+            hash = hashVector(hash, agents.global_list.at(i));
+            hash = hashVector(hash, agents.left_criticals.at(i));
+            hash = hashVector(hash, agents.right_criticals.at(i));
+            hash = hashBytes(hash, &agents.activation_thresholds.at(i), sizeof(uint32_t));
+        }
+
+        return hash;
+    }
+
+    // Compute the cache key of a sample
+    uint64_t computeSampleKey(ResponseCache const& cache, const std::vector<float>& sample)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+
+        if (!cache.quantize) {
+            return hashVector(hash, sample);
+        }
+
+        // Samples inside the same critical interval of every feature produce the same local lists
+        return hashVector(hash, computeSampleSignature(cache.signature_index, sample));
+    }
+
+    // Initialize an empty response cache for a trained model
+    ResponseCache initResponseCache(Agents const& agents, uint16_t const& n_presenters, uint16_t const& n_features, uint16_t const& activation_tau, uint32_t const& monitoring_rounds, bool const& fast_shuffle, uint32_t const& capacity, bool const& quantize)
+    {
+        ResponseCache cache;
+
+        cache.capacity = capacity;
+        cache.quantize = quantize;
+
+        // Raw and quantized keys never share a cache file
+        cache.model_fingerprint = computeModelFingerprint(agents, n_presenters, activation_tau, monitoring_rounds, fast_shuffle);
+        cache.model_fingerprint = hashBytes(cache.model_fingerprint, &cache.quantize, sizeof(cache.quantize));
+        if (quantize) {
+            cache.signature_index = buildSignatureIndex(agents, n_presenters, n_features);
+        }
+
+        return cache;
+    }
+
+    // Insert a response as the most recently used entry, evicting the least recently used one if full
+    void insertResponse(ResponseCache& cache, uint64_t const& key, uint32_t const& response)
+    {
+        if (cache.capacity == 0) {
+            return;
+        }
+
+        auto found = cache.index.find(key);
+        if (found != cache.index.end()) {
+            found->second->second = response;
+            cache.entries.splice(cache.entries.begin(), cache.entries, found->second);
+            return;
+        }
+
+        if (cache.entries.size() == cache.capacity) {
+            cache.index.erase(cache.entries.back().first);
+            cache.entries.pop_back();
+        }
+
+        cache.entries.emplace_front(key, response);
+        cache.index[key] = cache.entries.begin();
+    }
+
+    // Look up a cached response and mark it as the most recently used, return false on a miss
+    bool lookupResponse(ResponseCache& cache, uint64_t const& key, uint32_t& response)
+    {
+        auto found = cache.index.find(key);
+        if (found == cache.index.end()) {
+            return false;
+        }
+
+        cache.entries.splice(cache.entries.begin(), cache.entries, found->second);
+        response = found->second->second;
+
+        return true;
+    }
+
+    // Parse an unsigned decimal number taking the whole text, return false if it is malformed or above max_value
+    bool parseCacheNumber(std::string const& text, uint64_t const& max_value, uint64_t& value)
+    {
+        if (text.empty() || text.front() < '0' || text.front() > '9') {
+            return false;
+        }
+
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long const parsed = std::strtoull(text.c_str(), &end, 10);
+        if (errno == ERANGE || *end != '\0' || parsed > max_value) {
+            return false;
+        }
+        value = parsed;
+
+        return true;
+    }
+
+    // Load cached responses from a file, ignoring them if they belong to another model or the file is malformed
+    void loadResponseCache(std::string const& file_path, ResponseCache& cache)
+    {
+        // A missing cache file simply means a cold cache
+        std::ifstream file(file_path);
+        if (!file.is_open()) {
+            return;
+        }
+
+        // First line holds the model fingerprint
+        std::string line;
+        uint64_t fingerprint = 0;
+        if (!std::getline(file, line) || !parseCacheNumber(line, UINT64_MAX, fingerprint) || fingerprint != cache.model_fingerprint) {
+            return;
+        }
+
+        // Remaining lines hold key,response pairs from most to least recently used
+        std::vector<std::pair<uint64_t, uint32_t>> loaded;
+        while (std::getline(file, line)) {
+            std::size_t separator = line.find(',');
+            uint64_t key = 0;
+            uint64_t response = 0;
+            if (separator == std::string::npos || !parseCacheNumber(line.substr(0, separator), UINT64_MAX, key) || !parseCacheNumber(line.substr(separator + 1), UINT32_MAX, response)) {
+                return;
+            }
+            loaded.emplace_back(key, response);
+        }
+
+        // Insert from least to most recently used to keep the original order
+        for (auto it = loaded.rbegin(); it != loaded.rend(); ++it) {
+            insertResponse(cache, it->first, it->second);
+        }
+    }
+
+    // Export cached responses to a file
+    void exportResponseCache(std::ofstream& file, ResponseCache const& cache)
+    {
+        // Check if file opened correctly
+        if (!file.is_open()) {
+            std::cout << "Error opening file" << '\n';
+            std::exit(EXIT_FAILURE);
+        }
+
+        file << cache.model_fingerprint << '\n';
+        for (auto const& kv : cache.entries) {
+            file << kv.first << ',' << kv.second << '\n';
+        }
+    }
+
+} // namespace cfm
+
+#endif // CACHE_H
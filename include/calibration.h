@@ -0,0 +1,218 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include "monitoring.h"
+#include <cmath>    // erfc, sqrt, floor, ceil
+#include <limits>   // numeric_limits
+
+namespace cfm
+{
+
+    // Achieved confidence intervals of a sampled calibration
+    struct CalibrationReport
+    {
+        // Normal samples drawn into the subset out of all normal samples
+        uint32_t n_sampled = 0;
+        uint32_t n_normal = 0;
+
+        // Distinct samples simulated for the subset
+        uint32_t n_simulated = 0;
+
+        // Confidence level of the intervals
+        float confidence = 0;
+
+        // Largest half-width of the detectors' activation threshold intervals
+        float max_half_width = 0;
+
+        // Bounds of each detector's activation threshold interval
+        std::vector<uint32_t> low;
+        std::vector<uint32_t> high;
+    };
+
+    // Standard normal quantile leaving (1 - confidence) / 2 in the upper tail
+    double getNormalQuantile(double const& confidence)
+    {
+        double const tail = (1 - confidence) / 2;
+
+        // Bisection on the upper tail probability
+        double low = 0;
+        double high = 10;
+        for (uint16_t i = 0; i < 100; ++i) {
+            double const middle = (low + high) / 2;
+            if (0.5 * std::erfc(middle / std::sqrt(2.0)) > tail) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+
+        return (low + high) / 2;
+    }
+
+    // Registered taus of a simulated sample, one (tau, count) list per detector
+    using SampleTaus = std::vector<std::vector<std::pair<uint16_t, uint32_t>>>;
+
+    // Number of pairings for the activation tau from a detector's registered taus
+    uint32_t getSampleNumberPairings(const std::vector<std::pair<uint16_t, uint32_t>>& taus, uint16_t const& activation_tau)
+    {
+        uint32_t pairings = 0;
+        for (auto const& kv : taus) {
+            if (kv.first >= activation_tau) {
+                pairings += kv.second;
+            }
+        }
+
+        return pairings;
+    }
+
+    // Distribution-free confidence interval of each detector's activation threshold from the order statistics around its rank
+    void computeThresholdIntervals(CalibrationReport& report, const std::vector<std::vector<uint32_t>>& number_pairings, uint16_t const& activation_threshold_percent, double const& z)
+    {
+        uint32_t const n_samples = report.n_sampled;
+        double const fraction = (double)activation_threshold_percent / 100;
+        double const spread = z * std::sqrt(n_samples * fraction * (1 - fraction));
+
+        // Same rank as computeActivationThresholds
+        uint32_t const rank = (uint16_t)((n_samples - 1) * (float)activation_threshold_percent / 100);
+        uint32_t const high_rank = std::max(0.0, std::floor(rank - spread));
+        uint32_t const low_rank = std::min<double>(n_samples - 1, std::ceil(rank + spread));
+
+        report.low.resize(number_pairings.size());
+        report.high.resize(number_pairings.size());
+        report.max_half_width = 0;
+
+        // Too few samples to observe the interval's upper order statistic leave it unbounded
+        if (n_samples < report.n_normal && rank < spread) {
+            report.max_half_width = std::numeric_limits<float>::infinity();
+        }
+
+        std::vector<uint32_t> sorted;
+        for (uint16_t i = 0; i < number_pairings.size(); ++i) {
+            // Sort number of pairings from highest to lowest
+            sorted = number_pairings.at(i);
+            std::sort(sorted.rbegin(), sorted.rend());
+
+            // The whole population leaves no sampling error
+            if (n_samples == report.n_normal) {
+                report.low.at(i) = sorted.at(rank);
+                report.high.at(i) = sorted.at(rank);
+                continue;
+            }
+
+            report.low.at(i) = sorted.at(low_rank);
+            report.high.at(i) = sorted.at(high_rank);
+            report.max_half_width = std::max(report.max_half_width, (report.high.at(i) - report.low.at(i)) / 2.0f);
+        }
+    }
+
+    // Calibrate the activation tau and the detectors' activation thresholds with a random subset of the normal samples, grown by a batch at a time until every threshold's confidence interval has a half-width of at most max_error pairings, and optionally keep the subset's number of pairings
+    uint16_t calibrationSampled(Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint32_t const& monitoring_rounds, uint16_t const& n_features, const std::vector<std::vector<float>>& samples, const std::vector<uint16_t>& normal_samples, uint16_t const& activation_threshold_percent, SignatureIndex const& signature_index, float const& max_error, uint16_t const& confidence_percent, uint32_t const& batch_size, uint16_t const& seed, CalibrationReport& report, uint16_t const& n_threads = 1, std::vector<std::vector<uint32_t>>* normal_pairings = nullptr)
+    {
+        uint16_t const n_detectors = agents.id.size() - n_presenters;
+        double const z = getNormalQuantile((double)confidence_percent / 100);
+
+        // Random order in which normal samples join the subset
+        std::vector<uint16_t> order = normal_samples;
+        std::mt19937 generator(seed);
+        std::shuffle(order.begin(), order.end(), generator);
+
+        // Registered taus of every sample simulated so far (equivalent samples share the first one's)
+        std::vector<int32_t> sample_taus_index(samples.size(), -1);
+        std::vector<SampleTaus> sample_taus;
+
+        // All registered taus across the subset
+        std::vector<TausMap> calibration_taus_map(agents.id.size());
+
+        // Number of pairings for the activation tau of every normal sample of the subset
+        std::vector<std::vector<uint32_t>> number_pairings(n_detectors);
+
+        report = CalibrationReport();
+        report.n_normal = order.size();
+        report.confidence = (float)confidence_percent / 100;
+
+        uint16_t activation_tau = 0;
+        std::vector<uint16_t> new_samples;
+        while (report.n_sampled < report.n_normal) {
+            uint32_t const first = report.n_sampled;
+            uint32_t const last = std::min<uint32_t>(report.n_normal, first + std::max<uint32_t>(batch_size, 1));
+
+            // Samples of the batch not simulated yet
+            new_samples.clear();
+            for (uint32_t j = first; j < last; ++j) {
+                uint16_t const i = order.at(j);
+                if (sample_taus_index.at(i) < 0) {
+                    sample_taus_index.at(i) = sample_taus.size();
+                    sample_taus.emplace_back(n_detectors);
+                    new_samples.push_back(i);
+                }
+            }
+
+            // Simulate them over the workers
+            uint16_t const n_workers = std::max<std::size_t>(1, std::min<std::size_t>(n_threads, new_samples.size()));
+            std::vector<WorkerState> states = initWorkerStates(agents, workspace, n_workers);
+            runWorkStealing(n_workers, new_samples.size(), [&](uint16_t const worker, uint32_t const task) {
+                Agents& worker_agents = n_workers > 1 ? states[worker].agents : agents;
+                Workspace& worker_workspace = n_workers > 1 ? states[worker].workspace : workspace;
+                uint16_t const i = new_samples[task];
+
+                // Only detectors' lifetimes are kept
+                enableLazyTaus(worker_agents, n_presenters, 0);
+                monitoring(worker_agents, worker_workspace, n_presenters, monitoring_rounds, n_features, samples.at(i), 0, &signature_index);
+                disableLazyTaus(worker_agents);
+
+                SampleTaus& taus = sample_taus[sample_taus_index[i]];
+                for (uint16_t d = 0; d < n_detectors; ++d) {
+                    taus[d].assign(worker_agents.taus_map.at(n_presenters + d).begin(), worker_agents.taus_map.at(n_presenters + d).end());
+                }
+
+                // Reset some of the agents' data structures
+                resetAgentsMatch(worker_agents);
+                resetAgentsTau(worker_agents);
+                resetAgentsTausMap(worker_agents);
+            });
+
+            // Register the batch's taus
+            for (uint32_t j = first; j < last; ++j) {
+                SampleTaus const& taus = sample_taus.at(sample_taus_index.at(order.at(j)));
+                for (uint16_t d = 0; d < n_detectors; ++d) {
+                    for (auto const& kv : taus.at(d)) {
+                        calibration_taus_map.at(n_presenters + d)[kv.first] += kv.second;
+                    }
+                }
+            }
+            report.n_sampled = last;
+
+            // Compute activation tau of the subset
+            activation_tau = computeActivationTau(agents, n_presenters, calibration_taus_map, report.n_sampled);
+
+            // Number of pairings of the subset for its activation tau
+            for (uint16_t d = 0; d < n_detectors; ++d) {
+                number_pairings.at(d).resize(report.n_sampled);
+                for (uint32_t j = 0; j < report.n_sampled; ++j) {
+                    number_pairings.at(d).at(j) = getSampleNumberPairings(sample_taus.at(sample_taus_index.at(order.at(j))).at(d), activation_tau);
+                }
+            }
+
+            // Stop growing the subset once every threshold is within the error bound
+            computeThresholdIntervals(report, number_pairings, activation_threshold_percent, z);
+            if (report.max_half_width <= max_error) {
+                break;
+            }
+        }
+        report.n_simulated = sample_taus.size();
+
+        // Compute activation threshold for each detector
+        if (report.n_sampled > 0) {
+            computeActivationThresholds(agents, n_presenters, number_pairings, activation_threshold_percent, report.n_sampled);
+        }
+
+        if (normal_pairings != nullptr) {
+            *normal_pairings = std::move(number_pairings);
+        }
+
+        return activation_tau;
+    }
+
+} // namespace cfm
+
+#endif // CALIBRATION_H
@@ -0,0 +1,117 @@
+#ifndef CFM_API_H
+#define CFM_API_H
+
+/*
+ * C API of the Cellular Frustration Model library (libcfm).
+ *
+ * Thread safety:
+ * - Different models are fully independent and may be used from any threads.
+ * - cfm_model_score and cfm_model_serialize only read the model, so any number of
+ *   threads may call them concurrently on the same model.
+ * - cfm_model_train, cfm_model_calibrate and cfm_model_free modify the model and
+ *   must not run concurrently with any other call on the same model.
+ * - A scorer serves immutable snapshots of models: cfm_scorer_score and
+ *   cfm_scorer_publish may be called concurrently from any threads, scoring never
+ *   takes a lock, and only cfm_scorer_free must not run concurrently with them.
+ *
+ * Matrices are dense and row-major. Functions returning cfm_status never exit the
+ * process; failures are reported through the returned status.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define CFM_API __attribute__((visibility("default")))
+#else
+#define CFM_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct cfm_model cfm_model;
+typedef struct cfm_scorer cfm_scorer;
+
+typedef enum cfm_status
+{
+    CFM_OK = 0,
+    CFM_ERROR_ARGUMENT = 1,     /* Null pointer, size mismatch or malformed buffer */
+    CFM_ERROR_STATE = 2,        /* Model not calibrated yet */
+    CFM_ERROR_INTERNAL = 3      /* Unexpected failure inside the simulation */
+} cfm_status;
+
+/* Simulation parameters, named as in parameters.txt */
+typedef struct cfm_parameters
+{
+    uint16_t seed;
+    uint16_t sample_rounds;
+    uint32_t training_rounds;
+    uint16_t training_interval;
+    uint32_t monitoring_rounds;
+    uint16_t activation_threshold_percent;
+    uint16_t fast_shuffle;
+} cfm_parameters;
+
+/* Default parameters of create-defaults.sh */
+CFM_API cfm_parameters cfm_default_parameters(void);
+
+/*
+ * Create a model with n_features * n_presenters_sets presenters and as many detectors.
+ * global_lists holds one row of 2 * presenters ranks per detector, and left_criticals
+ * and right_criticals hold one row of n_features values per detector. Returns NULL on
+ * invalid arguments.
+ */
+CFM_API cfm_model* cfm_model_create(uint16_t n_features, uint16_t n_presenters_sets, const uint16_t* global_lists, const float* left_criticals, const float* right_criticals, const cfm_parameters* parameters);
+
+/* Release a model, NULL is ignored */
+CFM_API void cfm_model_free(cfm_model* model);
+
+/* Train the detectors' global lists, visiting samples in samples_queue order (NULL = stored order), whose entries must be below n_samples */
+CFM_API cfm_status cfm_model_train(cfm_model* model, const float* samples, uint32_t n_samples, const uint16_t* samples_queue);
+
+/* Calibrate the activation tau and the detectors' activation thresholds with normal samples */
+CFM_API cfm_status cfm_model_calibrate(cfm_model* model, const float* normal_samples, uint32_t n_normal_samples);
+
+/* Score samples into the caller-provided responses buffer of n_samples values */
+CFM_API cfm_status cfm_model_score(const cfm_model* model, const float* samples, uint32_t n_samples, uint32_t* responses);
+
+/* Copy the detectors' trained global lists (dense ranks) into a buffer of detectors * 2 * presenters values */
+CFM_API cfm_status cfm_model_global_lists(const cfm_model* model, uint16_t* global_lists);
+
+/*
+ * Serialize a model into buffer and return the number of bytes needed. Nothing is
+ * written when buffer is NULL or size is too small, so a first call can query the size.
+ */
+CFM_API size_t cfm_model_serialize(const cfm_model* model, void* buffer, size_t size);
+
+/* Create a model from a serialized buffer, NULL if the buffer is malformed */
+CFM_API cfm_model* cfm_model_deserialize(const void* buffer, size_t size);
+
+/* Create a scorer serving a snapshot of a calibrated model as version 1, NULL if the model is not calibrated */
+CFM_API cfm_scorer* cfm_scorer_create(const cfm_model* model);
+
+/* Release a scorer and every version it holds, NULL is ignored */
+CFM_API void cfm_scorer_free(cfm_scorer* scorer);
+
+/*
+ * Publish a snapshot of a calibrated model with the scorer's number of features as
+ * the next version. Samples already being scored finish on the version they started
+ * with, and every sample starting afterwards is scored with the new one. The model
+ * may be retrained or freed as soon as the call returns.
+ */
+CFM_API cfm_status cfm_scorer_publish(cfm_scorer* scorer, const cfm_model* model);
+
+/*
+ * Score samples into the caller-provided responses buffer of n_samples values. Each
+ * sample is scored with the version current when it starts, and versions, unless
+ * NULL, receives the version of each sample.
+ */
+CFM_API cfm_status cfm_scorer_score(cfm_scorer* scorer, const float* samples, uint32_t n_samples, uint32_t* responses, uint64_t* versions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CFM_API_H */
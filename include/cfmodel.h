@@ -1,12 +1,43 @@
 #ifndef CFMODEL_H
 #define CFMODEL_H
 
-#include "utils.h"
+#include "half.h"
+#include "permutation.h"
+#include "scheduler.h"
+#include "workspace.h"
 #include <random>   // mt19937, uniform_int_distribution
 
 namespace cfm
 {
 
+    // Storage type of detectors' critical values, half precision when built with -DCFM_HALF_CRITICALS
+#ifdef CFM_HALF_CRITICALS
+    using CriticalValue = HalfFloat;
+#else
+    using CriticalValue = float;
+#endif
+
+    // Lazy lifetime bookkeeping used by monitoring, where only detectors' long lifetimes are read
+    struct LazyTaus
+    {
+        bool enabled = false;
+
+        // Lifetimes are registered only for agents from this one onwards
+        uint16_t first_agent = 0;
+
+        // Shorter lifetimes are not registered. Longer ones are still kept per lifetime rather than in a single
+        // threshold-crossing counter, because the collective response sums the cumulative taus map over every
+        // registered lifetime from the activation tau, which depends on which lifetimes occurred and not only on
+        // how many crossed it
+        uint16_t tau_floor = 0;
+
+        // Current round, so lifetimes come from timestamps instead of per-round increments
+        uint32_t round = 0;
+
+        // Round in which each agent's current match started
+        std::vector<uint32_t> match_start;
+    };
+
     // Agents' properties
     struct Agents
     {
@@ -24,19 +55,28 @@ namespace cfm
         std::vector<uint32_t> tau;
 
         // All registered matching lifetimes
-        std::vector<std::map<uint16_t, uint32_t>> taus_map;
+        std::vector<TausMap> taus_map;
 
-        // Global preference list
+        // Longer lifetimes are registered under this one (0 registers every lifetime)
+        uint16_t tau_cap = 0;
+
+        // Lazy lifetime bookkeeping (disabled by default)
+        LazyTaus lazy;
+
+        // Global preference list (detectors' entries are order keys, dense ranks only after compaction)
         std::vector<std::vector<uint16_t>> global_list;
 
-        // Local preference list
-        std::vector<std::vector<uint16_t>> local_list;
+        // Next order key below the bottom of each detector's global list
+        std::vector<uint32_t> global_list_tail;
+
+        // Local preference list packed as one bit per presenter, set when its signal is out (entry j is 2*j plus the bit)
+        std::vector<std::vector<uint64_t>> local_list;
 
         // Features left critical values
-        std::vector<std::vector<float>> left_criticals;
+        std::vector<std::vector<CriticalValue>> left_criticals;
 
         // Features right critical values
-        std::vector<std::vector<float>> right_criticals;
+        std::vector<std::vector<CriticalValue>> right_criticals;
 
         // Activation threshold used for calculating responses
         std::vector<uint32_t> activation_thresholds;
@@ -50,18 +90,21 @@ namespace cfm
         }
     }
 
-    // Initialize agents' properties
-    Agents initAgents(uint16_t const& n_agents)
+    // Initialize the properties of presenters followed by detectors
+    Agents initAgents(uint16_t const& n_presenters, uint16_t const& n_detectors)
     {
         Agents agents;
 
+        uint16_t const n_agents = n_presenters + n_detectors;
         agents.id.resize(n_agents);
         agents.subtype.resize(n_agents);
         agents.match.resize(n_agents);
         agents.signal.resize(n_agents);
         agents.tau.resize(n_agents);
+        agents.lazy.match_start.resize(n_agents);
         agents.taus_map.resize(n_agents);
         agents.global_list.resize(n_agents);
+        agents.global_list_tail.resize(n_agents);
         agents.local_list.resize(n_agents);
         agents.left_criticals.resize(n_agents);
         agents.right_criticals.resize(n_agents);
@@ -70,9 +113,9 @@ namespace cfm
         for (uint16_t i = 0; i < n_agents; ++i) {
             agents.id.at(i) = i;
 
-            if (agents.id.at(i) < n_agents / 2) {
+            if (agents.id.at(i) < n_presenters) {
                 // Different subtypes for each half of presenters
-                if (agents.id.at(i) < n_agents / 4) {
+                if (agents.id.at(i) < n_presenters / 2) {
                     agents.subtype.at(i) = 0;
                     agents.global_list.at(i) = {agents.subtype.at(i), 1};
                 } else {
@@ -81,7 +124,7 @@ namespace cfm
                 }
             } else {
                 // Different subtypes for each half of detectors
-                if (agents.id.at(i) < n_agents * 3/4) {
+                if (agents.id.at(i) - n_presenters < n_detectors / 2) {
                     agents.subtype.at(i) = 0;
                     agents.signal.at(i) = agents.subtype.at(i);
                 } else {
@@ -97,11 +140,60 @@ namespace cfm
         return agents;
     }
 
+    // Initialize agents' properties, half of them presenters
+    Agents initAgents(uint16_t const& n_agents)
+    {
+        return initAgents(n_agents / 2, n_agents - n_agents / 2);
+    }
+
+    // Keep the rows of the given agents, in their order
+    template<class T>
+    void selectAgentsRows(std::vector<T>& rows, const std::vector<uint16_t>& agents_kept)
+    {
+        std::vector<T> selected;
+        selected.reserve(agents_kept.size());
+        for (auto const& id : agents_kept) {
+            selected.push_back(std::move(rows.at(id)));
+        }
+        rows = std::move(selected);
+    }
+
+    // Keep only the given detectors (ascending, counted from the first detector) and drop every row of the others
+    void pruneDetectors(Agents& agents, uint16_t const& n_presenters, const std::vector<uint16_t>& detectors_kept)
+    {
+        std::vector<uint16_t> agents_kept(n_presenters);
+        std::iota(agents_kept.begin(), agents_kept.end(), 0);
+        for (auto const& detector : detectors_kept) {
+            agents_kept.push_back(n_presenters + detector);
+        }
+
+        // Kept detectors keep their subtype and signal
+        selectAgentsRows(agents.subtype, agents_kept);
+        selectAgentsRows(agents.match, agents_kept);
+        selectAgentsRows(agents.signal, agents_kept);
+        selectAgentsRows(agents.tau, agents_kept);
+        selectAgentsRows(agents.lazy.match_start, agents_kept);
+        selectAgentsRows(agents.taus_map, agents_kept);
+        selectAgentsRows(agents.global_list, agents_kept);
+        selectAgentsRows(agents.global_list_tail, agents_kept);
+        selectAgentsRows(agents.local_list, agents_kept);
+        selectAgentsRows(agents.left_criticals, agents_kept);
+        selectAgentsRows(agents.right_criticals, agents_kept);
+        selectAgentsRows(agents.activation_thresholds, agents_kept);
+
+        agents.id.resize(agents_kept.size());
+        std::iota(agents.id.begin(), agents.id.end(), 0);
+
+        // Partners' ids have changed
+        resetAgentsMatch(agents);
+    }
+
     // Initialize detectors' global lists
     void initDetectorsGlobalLists(Agents& agents, uint16_t const& n_presenters, const std::vector<std::vector<uint16_t>>& global_lists)
     {
         uint16_t i = 0;
         for (auto const& row : global_lists) {
+            agents.global_list_tail.at(n_presenters + i) = row.size();
             agents.global_list.at(n_presenters + i++) = row;
         }
     }
@@ -111,11 +203,11 @@ namespace cfm
     {
         uint16_t i = 0;
         for (auto const& row : left_criticals) {
-            agents.left_criticals.at(n_presenters + i++) = row;
+            agents.left_criticals.at(n_presenters + i++).assign(row.begin(), row.end());
         }
         i = 0;
         for (auto const& row : right_criticals) {
-            agents.right_criticals.at(n_presenters + i++) = row;
+            agents.right_criticals.at(n_presenters + i++).assign(row.begin(), row.end());
         }
     }
 
@@ -132,12 +224,24 @@ namespace cfm
         }
     }
 
+    // Number of 64-bit words of a packed local list
+    uint16_t getLocalListWords(uint16_t const& n_presenters)
+    {
+        return (n_presenters + 63) / 64;
+    }
+
+    // Get a detector's local list entry for a presenter
+    uint16_t getLocalListEntry(Agents const& agents, uint16_t const& detector, uint16_t const& presenter)
+    {
+        return 2*presenter + ((agents.local_list.at(detector).at(presenter >> 6) >> (presenter & 63)) & 1);
+    }
+
     // Map presenters' signals to detectors' local lists
     void mapSignalsToDetectorsLocalLists(Agents& agents, uint16_t const& n_presenters, uint16_t const& n_features)
     {
         // Loop through detectors
         for (uint16_t i = n_presenters; i < agents.id.size(); ++i) {
-            agents.local_list.at(i).resize(n_presenters);
+            agents.local_list.at(i).assign(getLocalListWords(n_presenters), 0);
 
             // Loop through presenters
             uint16_t feature = 0;
@@ -154,13 +258,9 @@ namespace cfm
                 float left_critical = agents.left_criticals.at(i).at(feature);
                 float right_critical = agents.right_criticals.at(i).at(feature++);
 
-                // Signal out
+                // Signal out, signals in keep their bit cleared
                 if (signal <= left_critical || signal >= right_critical) {
-                    agents.local_list.at(i).at(j) = 2*j + 1;
-                }
-                // Signal in
-                else {
-                    agents.local_list.at(i).at(j) = 2*j + 0;
+                    agents.local_list.at(i).at(j >> 6) |= (uint64_t)1 << (j & 63);
                 }
             }
         }
@@ -176,22 +276,68 @@ namespace cfm
         mapSignalsToDetectorsLocalLists(agents, n_presenters, n_features);
     }
 
+    // Register lifetimes only for agents from first_agent onwards and only from tau_floor upwards, and stop counting taus every round
+    void enableLazyTaus(Agents& agents, uint16_t const& first_agent, uint16_t const& tau_floor)
+    {
+        agents.lazy.enabled = true;
+        agents.lazy.first_agent = first_agent;
+        agents.lazy.tau_floor = tau_floor;
+        agents.lazy.round = 0;
+    }
+
+    // Restore full lifetime bookkeeping
+    void disableLazyTaus(Agents& agents)
+    {
+        agents.lazy.enabled = false;
+    }
+
+    // Get an agent's current matching lifetime
+    uint32_t getAgentTau(Agents const& agents, uint16_t const& agent)
+    {
+        if (agents.lazy.enabled) {
+            return agents.match.at(agent) > -1 ? agents.lazy.round - agents.lazy.match_start.at(agent) : 0;
+        }
+
+        return agents.tau.at(agent);
+    }
+
+    // Register an agent's current matching lifetime
+    void registerAgentTau(Agents& agents, uint16_t const& agent)
+    {
+        if (agents.lazy.enabled && agent < agents.lazy.first_agent) {
+            return;
+        }
+
+        uint32_t tau = getAgentTau(agents, agent);
+        if (agents.tau_cap > 0 && tau > agents.tau_cap) {
+            tau = agents.tau_cap;
+        }
+
+        if (agents.lazy.enabled && tau < agents.lazy.tau_floor) {
+            return;
+        }
+
+        ++agents.taus_map.at(agent)[tau];
+    }
+
     // Update agent match
     void updateAgentMatch(Agents& agents, uint16_t const& agent, int16_t const& match)
     {
+        // Lazy lifetimes depend on the match that ends
+        registerAgentTau(agents, agent);
         agents.match.at(agent) = match;
-        ++agents.taus_map.at(agent)[agents.tau.at(agent)];
         agents.tau.at(agent) = 0;
+        agents.lazy.match_start.at(agent) = agents.lazy.round;
     }
 
     // Randomly unpair agents to avoid stable matchings
-    void dissociation(std::mt19937& generator, Agents& agents)
+    void dissociation(std::mt19937& generator, Agents& agents, Workspace& workspace)
     {
         // Dissociation probability
         std::uniform_int_distribution<uint16_t> distribution(0, 999);
 
         // Initialize interaction pairs dissociation probabilities
-        std::vector<uint16_t> dissociation_probabilities(agents.id.size());
+        std::vector<uint16_t>& dissociation_probabilities = workspace.dissociation_probabilities;
         std::generate(std::begin(dissociation_probabilities), std::end(dissociation_probabilities), [&]{ return distribution(generator); });
 
         // Loop through all agents
@@ -201,6 +347,8 @@ namespace cfm
             if (agent_partner > -1) {
                 // Dissociate
                 if (dissociation_probabilities.at(id) == 0) {
+                    ++workspace.dissociations;
+
                     // Agent
                     updateAgentMatch(agents, id, -1);
 
@@ -228,7 +376,7 @@ namespace cfm
         }
     }
 
-    // Get the rank of an agent's signal in another agent's global list
+    // Get the rank of an agent's signal in another agent's global list (only meaningful for comparisons)
     uint16_t getSignalRank(Agents& agents, uint16_t const& n_presenters, uint16_t const& agent, uint16_t const& agent_showing_signal)
     {
         // Presenters
@@ -236,20 +384,72 @@ namespace cfm
             return agents.global_list.at(agent).at(agents.signal.at(agent_showing_signal));
         }
         // Detectors
-        return agents.global_list.at(agent).at(agents.local_list.at(agent).at(agent_showing_signal));
+        return agents.global_list.at(agent).at(getLocalListEntry(agents, agent, agent_showing_signal));
     }
 
     // Return true if a detector sees a presenter's signal as normal and false otherwise
     bool getSignalNormality(Agents& agents, uint16_t const& detector, uint16_t const& presenter)
     {
         // Normal signal
-        if (agents.local_list.at(detector).at(presenter) % 2 == 0) {
+        if (getLocalListEntry(agents, detector, presenter) % 2 == 0) {
             return true;
         }
         // Abnormal signal
         return false;
     }
 
+    // Predicates of an interaction, as bits of a decision table index
+    uint16_t const DETECTOR_PARTNERED = 1 << 0;
+    uint16_t const PRESENTER_PARTNERED = 1 << 1;
+    uint16_t const PRESENTER_PREFERS_DETECTOR = 1 << 2;
+    uint16_t const PRESENTER_TIES_DETECTOR = 1 << 3;
+    uint16_t const DETECTOR_PREFERS_PRESENTER = 1 << 4;
+    uint16_t const DETECTOR_SEES_PRESENTER_NORMAL = 1 << 5;
+    uint16_t const DETECTOR_SEES_PARTNER_NORMAL = 1 << 6;
+    uint16_t const PARTNER_SEES_PRESENTER_NORMAL = 1 << 7;
+    uint16_t const N_DECISION_PREDICATES = 8;
+
+    // Return true if the decision rules pair the presenter and the detector given an interaction's predicates
+    bool getDecisionOutcome(uint16_t const& predicates)
+    {
+        bool const detector_partnered = predicates & DETECTOR_PARTNERED;
+        bool const presenter_partnered = predicates & PRESENTER_PARTNERED;
+        bool const presenter_prefers = predicates & PRESENTER_PREFERS_DETECTOR;
+        bool const presenter_ties = predicates & PRESENTER_TIES_DETECTOR;
+        bool const detector_prefers = predicates & DETECTOR_PREFERS_PRESENTER;
+        bool const detector_normal = predicates & DETECTOR_SEES_PRESENTER_NORMAL;
+        bool const detector_partner_normal = predicates & DETECTOR_SEES_PARTNER_NORMAL;
+        bool const presenter_partner_normal = predicates & PARTNER_SEES_PRESENTER_NORMAL;
+
+        if (!detector_partnered) {
+            if (!presenter_partnered) { // Rule 1
+                return true;
+            }
+            // Check presenter's preference, Rule 3, or how detectors see presenter's signal, Rule 4
+            return presenter_prefers || (presenter_ties && detector_normal && !presenter_partner_normal);
+        }
+
+        if (!presenter_partnered) { // Rule 2
+            return detector_prefers;
+        }
+
+        // Check both preferences, Rule 5, or how detectors see presenters' signals, Rule 6
+        return detector_prefers && (presenter_prefers || (presenter_ties && detector_normal && !detector_partner_normal && !presenter_partner_normal));
+    }
+
+    // Outcome of the decision rules for every combination of predicates
+    std::vector<uint8_t> initDecisionTable()
+    {
+        std::vector<uint8_t> decision_table(1 << N_DECISION_PREDICATES);
+        for (uint16_t predicates = 0; predicates < decision_table.size(); ++predicates) {
+            decision_table[predicates] = getDecisionOutcome(predicates);
+        }
+
+        return decision_table;
+    }
+
+    std::vector<uint8_t> const DECISION_TABLE = initDecisionTable();
+
     // Decision rules for pairing agents
     void decisionRules(Agents& agents, uint16_t const& n_presenters, uint16_t const& presenter, uint16_t const& detector)
     {
@@ -259,61 +459,170 @@ namespace cfm
         // Detector's partner
         int16_t detector_partner = agents.match.at(detector);
 
-        if (detector_partner == -1) {
-            if (presenter_partner == -1) { // Rule 1
-                updateAgentPairs(agents, presenter, presenter_partner, detector, detector_partner);
-            } else {
-                // Check presenter's preference
-                if (getSignalRank(agents, n_presenters, presenter, detector) < getSignalRank(agents, n_presenters, presenter, presenter_partner)) { // Rule 3
-                    updateAgentPairs(agents, presenter, presenter_partner, detector, detector_partner);
-                } else if (getSignalRank(agents, n_presenters, presenter, detector) == getSignalRank(agents, n_presenters, presenter, presenter_partner)) {
-                    // Check how detectors see presenter's signal (as normal or abnormal)
-                    if (getSignalNormality(agents, detector, presenter) && !getSignalNormality(agents, presenter_partner, presenter)) { // Rule 4
-                        updateAgentPairs(agents, presenter, presenter_partner, detector, detector_partner);
-                    }
-                }
-            }
-        } else {
-            if (presenter_partner == -1) {
-                // Check detector's preference
-                if (getSignalRank(agents, n_presenters, detector, presenter) < getSignalRank(agents, n_presenters, detector, detector_partner)) { // Rule 2
-                    updateAgentPairs(agents, presenter, presenter_partner, detector, detector_partner);
-                }
-            } else {
-                // Check detector's preference
-                if (getSignalRank(agents, n_presenters, detector, presenter) < getSignalRank(agents, n_presenters, detector, detector_partner)) {
-                    // Check presenter's preference
-                    if (getSignalRank(agents, n_presenters, presenter, detector) < getSignalRank(agents, n_presenters, presenter, presenter_partner)) { // Rule 5
-                        updateAgentPairs(agents, presenter, presenter_partner, detector, detector_partner);
-                    } else if (getSignalRank(agents, n_presenters, presenter, detector) == getSignalRank(agents, n_presenters, presenter, presenter_partner)) {
-                        // Check how detectors see presenters' signals (as normal or abnormal)
-                        if (getSignalNormality(agents, detector, presenter) && !getSignalNormality(agents, detector, detector_partner) && !getSignalNormality(agents, presenter_partner, presenter)) { // Rule 6
-                            updateAgentPairs(agents, presenter, presenter_partner, detector, detector_partner);
-                        }
-                    }
-                }
-            }
+        // Missing partners are stood in for by the other agent of the interaction, whose predicates the table ignores, so
+        // every predicate is computed without branching on which rule applies
+        uint16_t const presenter_rival = presenter_partner > -1 ? presenter_partner : detector;
+        uint16_t const detector_rival = detector_partner > -1 ? detector_partner : presenter;
+
+        // Presenters rank detectors' signals, detectors rank presenters' local list entries
+        uint16_t const* presenter_list = agents.global_list[presenter].data();
+        uint16_t const* detector_list = agents.global_list[detector].data();
+        uint64_t const* detector_local_list = agents.local_list[detector].data();
+        uint64_t const* rival_local_list = agents.local_list[presenter_rival].data();
+
+        uint16_t const presenter_rank = presenter_list[(uint16_t)agents.signal[detector]];
+        uint16_t const presenter_rival_rank = presenter_list[(uint16_t)agents.signal[presenter_rival]];
+
+        // Bits are set for signals out
+        uint16_t const presenter_bit = (detector_local_list[presenter >> 6] >> (presenter & 63)) & 1;
+        uint16_t const detector_rival_bit = (detector_local_list[detector_rival >> 6] >> (detector_rival & 63)) & 1;
+        uint16_t const rival_presenter_bit = (rival_local_list[presenter >> 6] >> (presenter & 63)) & 1;
+
+        uint16_t const predicates = (detector_partner > -1) * DETECTOR_PARTNERED
+            | (presenter_partner > -1) * PRESENTER_PARTNERED
+            | (presenter_rank < presenter_rival_rank) * PRESENTER_PREFERS_DETECTOR
+            | (presenter_rank == presenter_rival_rank) * PRESENTER_TIES_DETECTOR
+            | (detector_list[2*presenter + presenter_bit] < detector_list[2*detector_rival + detector_rival_bit]) * DETECTOR_PREFERS_PRESENTER
+            | (presenter_bit ^ 1) * DETECTOR_SEES_PRESENTER_NORMAL
+            | (detector_rival_bit ^ 1) * DETECTOR_SEES_PARTNER_NORMAL
+            | (rival_presenter_bit ^ 1) * PARTNER_SEES_PRESENTER_NORMAL;
+
+        if (DECISION_TABLE[predicates]) {
+            updateAgentPairs(agents, presenter, presenter_partner, detector, detector_partner);
         }
     }
 
-    // Agents' interaction and pairing dynamics
-    void interactions(std::mt19937& generator, Agents& agents, uint16_t const& n_presenters, std::vector<uint16_t>& interactions_queue, std::vector<uint16_t>& interaction_pairs)
+    // Agents' interaction and pairing dynamics over a shuffled interactions queue
+    void interactions(Agents& agents, uint16_t const& n_presenters, const std::vector<uint16_t>& interactions_queue, const std::vector<uint16_t>& interaction_pairs)
     {
-        // Shuffle interactions queue
-        std::shuffle(interactions_queue.begin(), interactions_queue.end(), generator);
-
-        // Shuffle interaction pairs
-        std::shuffle(interaction_pairs.begin(), interaction_pairs.end(), generator);
-
         for (auto const& interaction : interactions_queue) {
             uint16_t presenter = interaction;
             uint16_t detector = interaction_pairs.at(interaction);
 
+            // Presenters left without a detector by pruning sit the round out
+            if (detector == NO_DETECTOR) {
+                continue;
+            }
+
             // Decide interaction outcome
             decisionRules(agents, n_presenters, presenter, detector);
         }
     }
 
+    // Interactions run by the workers of a batch
+    struct InteractionBatch
+    {
+        Agents* agents;
+        uint16_t n_presenters;
+        std::vector<uint16_t> const* interactions;
+        std::vector<uint16_t> const* interaction_pairs;
+        uint16_t n_workers;
+    };
+
+    // Decide the outcomes of a worker's share of a batch
+    void runInteractionBatch(void* context, uint16_t worker)
+    {
+        InteractionBatch const& batch = *static_cast<InteractionBatch*>(context);
+        uint32_t const size = batch.interactions->size();
+        uint32_t const first = (uint64_t)size * worker / batch.n_workers;
+        uint32_t const last = (uint64_t)size * (worker + 1) / batch.n_workers;
+
+        for (uint32_t i = first; i < last; ++i) {
+            uint16_t presenter = (*batch.interactions)[i];
+            uint16_t detector = (*batch.interaction_pairs)[presenter];
+            if (detector == NO_DETECTOR) {
+                continue;
+            }
+
+            decisionRules(*batch.agents, batch.n_presenters, presenter, detector);
+        }
+    }
+
+    // Batches smaller than this are not worth waking the workers
+    uint32_t const MIN_PARALLEL_BATCH = 256;
+
+    // Claim an agent for the current batch, return false if another interaction already did
+    bool claimAgent(Workspace& workspace, int16_t const& agent)
+    {
+        if (agent < 0) {
+            return true;
+        }
+
+        bool const free = workspace.agent_claims[agent] != workspace.batch_stamp;
+        workspace.agent_claims[agent] = workspace.batch_stamp;
+        return free;
+    }
+
+    // Agents' interaction and pairing dynamics split into batches of independent interactions run in parallel
+    void interactionsBatched(Agents& agents, uint16_t const& n_presenters, Workspace& workspace, RoundWorkers& workers)
+    {
+        std::vector<uint16_t>& batch = workspace.batch_interactions;
+        std::vector<uint16_t>& deferred = workspace.deferred_interactions;
+        deferred.assign(workspace.interactions_queue.begin(), workspace.interactions_queue.end());
+
+        InteractionBatch context{&agents, n_presenters, &batch, &workspace.interaction_pairs, workers.n_workers};
+
+        while (!deferred.empty()) {
+            // New claims stamp, clearing old stamps when the counter wraps around
+            if (++workspace.batch_stamp == 0) {
+                std::fill(workspace.agent_claims.begin(), workspace.agent_claims.end(), 0);
+                workspace.batch_stamp = 1;
+            }
+
+            // An interaction only touches its presenter, its detector and their partners. It joins
+            // the batch if none of them is claimed by an earlier interaction, batched or deferred,
+            // so each batch gives the same outcomes as running the queue in order
+            batch.clear();
+            std::size_t n_deferred = 0;
+            for (auto const& presenter : deferred) {
+                uint16_t const detector = workspace.interaction_pairs[presenter];
+                if (detector == NO_DETECTOR) {
+                    continue;
+                }
+
+                int16_t const presenter_partner = agents.match[presenter];
+                int16_t const detector_partner = agents.match[detector];
+
+                // Already paired agents touch only themselves
+                bool independent = claimAgent(workspace, presenter);
+                independent &= claimAgent(workspace, detector);
+                if (presenter_partner != detector) {
+                    independent &= claimAgent(workspace, presenter_partner);
+                    independent &= claimAgent(workspace, detector_partner);
+                }
+
+                if (independent) {
+                    batch.push_back(presenter);
+                } else {
+                    deferred[n_deferred++] = presenter;
+                }
+            }
+            deferred.resize(n_deferred);
+
+            // Decide the batch's outcomes
+            if (batch.size() >= MIN_PARALLEL_BATCH && workers.n_workers > 1) {
+                runRoundJob(workers, runInteractionBatch, &context);
+            } else {
+                context.n_workers = 1;
+                runInteractionBatch(&context, 0);
+                context.n_workers = workers.n_workers;
+            }
+        }
+    }
+
+    // Run a round of interactions, in parallel batches when the workspace has round workers
+    void runInteractions(std::mt19937& generator, Agents& agents, uint16_t const& n_presenters, Workspace& workspace)
+    {
+        // Same draws for serial and parallel rounds
+        shuffleInteractions(generator, workspace);
+
+        if (workspace.round_workers != nullptr) {
+            interactionsBatched(agents, n_presenters, workspace, *workspace.round_workers);
+        } else {
+            interactions(agents, n_presenters, workspace.interactions_queue, workspace.interaction_pairs);
+        }
+    }
+
     // Update agents' metrics
     void updateAgentsMetrics(Agents& agents)
     {
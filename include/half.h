@@ -0,0 +1,98 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include "utils.h"
+#include <cmath>    // ldexp
+#include <cstring>  // memcpy
+
+namespace cfm
+{
+
+    // Convert a float to IEEE half precision bits, rounding to nearest even
+    uint16_t floatToHalfBits(float const& value)
+    {
+        uint32_t x;
+        std::memcpy(&x, &value, sizeof(x));
+
+        uint32_t const sign = (x >> 16) & 0x8000;
+        uint32_t const float_exponent = (x >> 23) & 0xff;
+        uint32_t mantissa = x & 0x7fffff;
+
+        // Infinity and NaN
+        if (float_exponent == 0xff) {
+            return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+        }
+
+        int32_t const exponent = (int32_t)float_exponent - 127 + 15;
+
+        // Overflow to infinity
+        if (exponent >= 31) {
+            return sign | 0x7c00;
+        }
+
+        // Subnormal half, or zero below half of the smallest one
+        if (exponent <= 0) {
+            if (exponent < -10) {
+                return sign;
+            }
+            mantissa |= 0x800000;
+            uint32_t const shift = 14 - exponent;
+            uint32_t half = mantissa >> shift;
+            uint32_t const rest = mantissa & ((1u << shift) - 1);
+            uint32_t const halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1))) {
+                ++half;
+            }
+            return sign | half;
+        }
+
+        // Normal half, a rounding carry correctly moves into the exponent
+        uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+        uint32_t const rest = mantissa & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+            ++half;
+        }
+        return sign | half;
+    }
+
+    // Convert IEEE half precision bits to a float
+    float halfBitsToFloat(uint16_t const& bits)
+    {
+        uint32_t const sign = (uint32_t)(bits & 0x8000) << 16;
+        uint32_t const exponent = (bits >> 10) & 0x1f;
+        uint32_t const mantissa = bits & 0x3ff;
+
+        uint32_t x;
+        if (exponent == 0x1f) {
+            x = sign | 0x7f800000 | (mantissa << 13);
+        } else if (exponent == 0) {
+            // Zero and subnormals
+            float const value = std::ldexp((float)mantissa, -24);
+            return sign != 0 ? -value : value;
+        } else {
+            x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+
+        float value;
+        std::memcpy(&value, &x, sizeof(value));
+        return value;
+    }
+
+    // Half precision value converting to and from float
+    struct HalfFloat
+    {
+        uint16_t bits = 0;
+
+        HalfFloat() = default;
+
+        HalfFloat(float const& value) : bits(floatToHalfBits(value)) {}
+
+        operator float() const
+        {
+            return halfBitsToFloat(bits);
+        }
+    };
+
+} // namespace cfm
+
+#endif // HALF_H
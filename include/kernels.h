@@ -0,0 +1,122 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "cfmodel.h"
+#include <array>    // array
+
+// Model shapes (features, presenters sets) with specialized kernels, extend to match deployed models
+#define CFM_KERNEL_SHAPES(SHAPE) \
+    SHAPE(11, 10) \
+    SHAPE(11, 5) \
+    SHAPE(11, 2)
+
+namespace cfm
+{
+
+    // Call a function with every index below N, unrolled at compile time
+    template<uint16_t N>
+    struct Unrolled
+    {
+        template<class Function>
+        static void apply(Function&& function)
+        {
+            Unrolled<N - 1>::apply(function);
+            function(N - 1);
+        }
+    };
+
+    template<>
+    struct Unrolled<0>
+    {
+        template<class Function>
+        static void apply(Function&&) {}
+    };
+
+    // Map sample features to presenters' signals for a fixed model shape
+    template<uint16_t N_FEATURES, uint16_t N_SETS>
+    void mapSampleToPresentersSignalsFixed(Agents& agents, const std::vector<float>& sample)
+    {
+        float* signals = agents.signal.data();
+        float const* features = sample.data();
+
+        for (uint16_t set = 0; set < N_SETS; ++set) {
+            Unrolled<N_FEATURES>::apply([&](uint16_t feature) { signals[set * N_FEATURES + feature] = features[feature]; });
+        }
+    }
+
+    // Map presenters' signals to detectors' local lists for a fixed model shape
+    template<uint16_t N_FEATURES, uint16_t N_SETS>
+    void mapSignalsToDetectorsLocalListsFixed(Agents& agents)
+    {
+        constexpr uint16_t n_presenters = N_FEATURES * N_SETS;
+        constexpr uint16_t n_words = (n_presenters + 63) / 64;
+        float const* signals = agents.signal.data();
+
+        // Loop through detectors
+        for (uint16_t i = n_presenters; i < 2 * n_presenters; ++i) {
+            agents.local_list[i].assign(n_words, 0);
+            uint64_t* local_list = agents.local_list[i].data();
+            CriticalValue const* left_criticals = agents.left_criticals[i].data();
+            CriticalValue const* right_criticals = agents.right_criticals[i].data();
+
+            // Every presenter set shows the same features, so each feature is checked once
+            std::array<uint16_t, N_FEATURES> signal_out;
+            Unrolled<N_FEATURES>::apply([&](uint16_t feature) {
+                signal_out[feature] = signals[feature] <= left_criticals[feature] || signals[feature] >= right_criticals[feature];
+            });
+
+            // Loop through presenters
+            for (uint16_t set = 0; set < N_SETS; ++set) {
+                Unrolled<N_FEATURES>::apply([&](uint16_t feature) {
+                    uint16_t const j = set * N_FEATURES + feature;
+                    local_list[j >> 6] |= (uint64_t)signal_out[feature] << (j & 63);
+                });
+            }
+        }
+    }
+
+    // Change sample and map its features to signals for a fixed model shape
+    template<uint16_t N_FEATURES, uint16_t N_SETS>
+    void changeSampleFixed(Agents& agents, const std::vector<float>& sample)
+    {
+        mapSampleToPresentersSignalsFixed<N_FEATURES, N_SETS>(agents, sample);
+        mapSignalsToDetectorsLocalListsFixed<N_FEATURES, N_SETS>(agents);
+    }
+
+    // Find the specialized sample change kernel of a model shape, or null if there is none
+    ChangeSampleKernel selectChangeSampleKernel(uint16_t const& n_presenters, uint16_t const& n_features)
+    {
+        // Specialized kernels assume one detector per presenter and whole presenter sets
+        if (n_features == 0 || n_presenters % n_features != 0) {
+            return nullptr;
+        }
+        uint16_t const n_sets = n_presenters / n_features;
+
+#define CFM_SELECT_KERNEL(FEATURES, SETS) \
+        if (n_features == FEATURES && n_sets == SETS) { \
+            return &changeSampleFixed<FEATURES, SETS>; \
+        }
+        CFM_KERNEL_SHAPES(CFM_SELECT_KERNEL)
+#undef CFM_SELECT_KERNEL
+
+        return nullptr;
+    }
+
+    // Change sample with the specialized kernel of the model shape, falling back to the generic one
+    void changeSampleDispatch(Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint16_t const& n_features, const std::vector<float>& sample)
+    {
+        if (!workspace.kernel_selected) {
+            workspace.change_sample_kernel = agents.id.size() == 2 * n_presenters ? selectChangeSampleKernel(n_presenters, n_features) : nullptr;
+            workspace.kernel_selected = true;
+        }
+
+        if (workspace.change_sample_kernel != nullptr) {
+            workspace.change_sample_kernel(agents, sample);
+        } else {
+            changeSample(agents, n_presenters, n_features, sample);
+        }
+    }
+
+} // namespace cfm
+
+#endif // KERNELS_H
@@ -0,0 +1,84 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include "cfmodel.h"
+
+namespace cfm
+{
+
+    // Bytes held by one of the agents' fields at one phase of a run
+    struct MemoryUsage
+    {
+        std::string phase;
+        std::string field;
+        std::size_t bytes;
+    };
+
+    // Estimated bytes of a taus map node: the entry plus the tree's three links and color
+    std::size_t const TAUS_MAP_NODE_BYTES = sizeof(TausMap::value_type) + 4 * sizeof(void*);
+
+    // Bytes reserved by a vector
+    template<class T>
+    std::size_t getVectorBytes(const std::vector<T>& vector_data)
+    {
+        return vector_data.capacity() * sizeof(T);
+    }
+
+    // Bytes reserved by a vector of rows and all its rows
+    template<class T>
+    std::size_t getMatrixBytes(const std::vector<std::vector<T>>& matrix)
+    {
+        std::size_t bytes = getVectorBytes(matrix);
+        for (auto const& row : matrix) {
+            bytes += getVectorBytes(row);
+        }
+
+        return bytes;
+    }
+
+    // Bytes held by the agents' taus maps
+    std::size_t getTausMapsBytes(const std::vector<TausMap>& taus_maps)
+    {
+        std::size_t bytes = getVectorBytes(taus_maps);
+        for (auto const& taus_map : taus_maps) {
+            bytes += taus_map.size() * TAUS_MAP_NODE_BYTES;
+        }
+
+        return bytes;
+    }
+
+    // Register the bytes held by each of the agents' fields and their total
+    void recordAgentsMemory(std::vector<MemoryUsage>& report, Agents const& agents, std::string const& phase)
+    {
+        std::size_t const first = report.size();
+
+        report.push_back({phase, "id", getVectorBytes(agents.id)});
+        report.push_back({phase, "subtype", getVectorBytes(agents.subtype)});
+        report.push_back({phase, "match", getVectorBytes(agents.match)});
+        report.push_back({phase, "signal", getVectorBytes(agents.signal)});
+        report.push_back({phase, "tau", getVectorBytes(agents.tau)});
+        report.push_back({phase, "taus_map", getTausMapsBytes(agents.taus_map)});
+        report.push_back({phase, "global_list", getMatrixBytes(agents.global_list) + getVectorBytes(agents.global_list_tail)});
+        report.push_back({phase, "local_list", getMatrixBytes(agents.local_list)});
+        report.push_back({phase, "left_criticals", getMatrixBytes(agents.left_criticals)});
+        report.push_back({phase, "right_criticals", getMatrixBytes(agents.right_criticals)});
+        report.push_back({phase, "activation_thresholds", getVectorBytes(agents.activation_thresholds)});
+
+        std::size_t total = 0;
+        for (std::size_t i = first; i < report.size(); ++i) {
+            total += report.at(i).bytes;
+        }
+        report.push_back({phase, "total", total});
+    }
+
+    // Export a memory report as phase, field and bytes rows
+    void exportMemoryReport(std::ofstream& file, const std::vector<MemoryUsage>& report)
+    {
+        for (auto const& usage : report) {
+            file << usage.phase << ',' << usage.field << ',' << usage.bytes << '\n';
+        }
+    }
+
+} // namespace cfm
+
+#endif // MEMORY_H
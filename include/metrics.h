@@ -0,0 +1,216 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "utils.h"
+#include <atomic>               // atomic
+#include <chrono>               // steady_clock, duration, milliseconds
+#include <condition_variable>   // condition_variable
+#include <cstdio>               // rename
+#include <mutex>                // mutex, unique_lock, lock_guard
+#include <thread>               // thread
+
+namespace cfm
+{
+
+    // Simulation phases reported by the live metrics
+    enum MetricsPhase : uint8_t
+    {
+        METRICS_UNTRAINED = 0,
+        METRICS_TRAINING = 1,
+        METRICS_TRAINED = 2,
+        METRICS_CALIBRATION = 3,
+        METRICS_PRUNING = 4,
+        METRICS_RESPONSES = 5
+    };
+
+    // Label of each phase in the exported metrics
+    char const* const METRICS_PHASE_NAMES[] = {"untrained", "training", "trained", "calibration", "pruning", "responses"};
+    uint8_t const N_METRICS_PHASES = 6;
+
+    // Progress counters updated by the simulations with relaxed atomics, and exported periodically by a background thread
+    struct LiveMetrics
+    {
+        // Rounds simulated and samples monitored since the start
+        std::atomic<uint64_t> rounds{0};
+        std::atomic<uint64_t> samples{0};
+
+        // Detectors educated since the start and in the latest education session
+        std::atomic<uint64_t> educations{0};
+        std::atomic<uint32_t> session_educations{0};
+
+        // Current education threshold
+        std::atomic<uint32_t> education_threshold{0};
+
+        // Current phase, its expected work (rounds while training, samples afterwards) and the counter value it started from
+        std::atomic<uint8_t> phase{METRICS_UNTRAINED};
+        std::atomic<uint64_t> phase_work{0};
+        std::atomic<uint64_t> phase_start{0};
+
+        // Exposition file, replaced atomically at every export
+        std::string file_path;
+        std::chrono::milliseconds interval{1000};
+
+        // Counters at the previous export, used for the rates
+        std::chrono::steady_clock::time_point last_export;
+        uint64_t last_rounds = 0;
+        uint64_t last_samples = 0;
+
+        std::mutex mutex;
+        std::condition_variable stop;
+        bool stopping = false;
+        std::thread thread;
+    };
+
+    // Whether a phase measures its work in rounds rather than samples
+    bool isRoundsPhase(uint8_t const& phase)
+    {
+        return phase <= METRICS_TRAINED;
+    }
+
+    // Enter a phase expecting work rounds (simulation phases) or samples (calibration, pruning and responses)
+    void setMetricsPhase(LiveMetrics* metrics, uint8_t const& phase, uint64_t const& work)
+    {
+        if (metrics == nullptr) {
+            return;
+        }
+
+        metrics->phase_start.store(isRoundsPhase(phase) ? metrics->rounds.load(std::memory_order_relaxed) : metrics->samples.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        metrics->phase_work.store(work, std::memory_order_relaxed);
+        metrics->phase.store(phase, std::memory_order_relaxed);
+    }
+
+    // Count simulated rounds
+    void addMetricsRounds(LiveMetrics* metrics, uint64_t const& rounds)
+    {
+        if (metrics != nullptr) {
+            metrics->rounds.fetch_add(rounds, std::memory_order_relaxed);
+        }
+    }
+
+    // Count a monitored sample and its rounds
+    void addMetricsSample(LiveMetrics* metrics, uint64_t const& rounds)
+    {
+        if (metrics != nullptr) {
+            metrics->rounds.fetch_add(rounds, std::memory_order_relaxed);
+            metrics->samples.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Count samples monitored elsewhere (e.g. by worker processes) and their rounds
+    void addMetricsSamples(LiveMetrics* metrics, uint64_t const& samples, uint64_t const& rounds)
+    {
+        if (metrics != nullptr) {
+            metrics->rounds.fetch_add(rounds, std::memory_order_relaxed);
+            metrics->samples.fetch_add(samples, std::memory_order_relaxed);
+        }
+    }
+
+    // Count an education session's educated detectors and the threshold it left
+    void addMetricsEducation(LiveMetrics* metrics, uint32_t const& educations, uint32_t const& threshold)
+    {
+        if (metrics != nullptr) {
+            metrics->educations.fetch_add(educations, std::memory_order_relaxed);
+            metrics->session_educations.store(educations, std::memory_order_relaxed);
+            metrics->education_threshold.store(threshold, std::memory_order_relaxed);
+        }
+    }
+
+    // Write a metric with its help and type lines, counters keep every digit
+    template<class T>
+    void writeMetric(std::ofstream& file, char const* name, char const* type, char const* help, T const& value)
+    {
+        file << "# HELP " << name << ' ' << help << '\n';
+        file << "# TYPE " << name << ' ' << type << '\n';
+        file << name << ' ' << value << '\n';
+    }
+
+    // Export the counters in the Prometheus text format, writing a temporary file renamed over the previous export
+    void exportMetrics(LiveMetrics& metrics)
+    {
+        std::chrono::steady_clock::time_point const now = std::chrono::steady_clock::now();
+        double const seconds = std::chrono::duration<double>(now - metrics.last_export).count();
+
+        uint64_t const rounds = metrics.rounds.load(std::memory_order_relaxed);
+        uint64_t const samples = metrics.samples.load(std::memory_order_relaxed);
+        uint8_t const phase = metrics.phase.load(std::memory_order_relaxed);
+
+        double const rounds_rate = seconds > 0 ? (rounds - metrics.last_rounds) / seconds : 0;
+        double const samples_rate = seconds > 0 ? (samples - metrics.last_samples) / seconds : 0;
+
+        // Remaining work of the phase at the current rate (-1 while unknown)
+        uint64_t const work = metrics.phase_work.load(std::memory_order_relaxed);
+        uint64_t const done = (isRoundsPhase(phase) ? rounds : samples) - metrics.phase_start.load(std::memory_order_relaxed);
+        uint64_t const remaining = work > done ? work - done : 0;
+        double const rate = isRoundsPhase(phase) ? rounds_rate : samples_rate;
+        double const eta = remaining == 0 ? 0 : (rate > 0 ? remaining / rate : -1);
+
+        metrics.last_export = now;
+        metrics.last_rounds = rounds;
+        metrics.last_samples = samples;
+
+        std::string const temporary_path = metrics.file_path + ".tmp";
+        std::ofstream file(temporary_path);
+        if (!file.is_open()) {
+            return;
+        }
+
+        file << "# HELP cfm_phase Current phase of the job (1 for the current one)" << '\n';
+        file << "# TYPE cfm_phase gauge" << '\n';
+        for (uint8_t i = 0; i < N_METRICS_PHASES; ++i) {
+            file << "cfm_phase{phase=\"" << METRICS_PHASE_NAMES[i] << "\"} " << (i == phase) << '\n';
+        }
+        writeMetric(file, "cfm_rounds_total", "counter", "Simulated rounds", rounds);
+        writeMetric(file, "cfm_rounds_per_second", "gauge", "Simulated rounds per second over the last interval", rounds_rate);
+        writeMetric(file, "cfm_samples_scored_total", "counter", "Monitored samples", samples);
+        writeMetric(file, "cfm_samples_scored_per_second", "gauge", "Monitored samples per second over the last interval", samples_rate);
+        writeMetric(file, "cfm_phase_progress_ratio", "gauge", "Completed fraction of the current phase", work > 0 ? std::min<double>(1, (double)done / work) : 0.0);
+        writeMetric(file, "cfm_phase_eta_seconds", "gauge", "Estimated seconds left in the current phase (-1 when unknown)", eta);
+        writeMetric(file, "cfm_education_threshold", "gauge", "Current education threshold", metrics.education_threshold.load(std::memory_order_relaxed));
+        writeMetric(file, "cfm_detectors_educated_total", "counter", "Educated detectors", metrics.educations.load(std::memory_order_relaxed));
+        writeMetric(file, "cfm_detectors_educated_per_interval", "gauge", "Detectors educated in the latest training interval", metrics.session_educations.load(std::memory_order_relaxed));
+        file.close();
+
+        // Scrapers never see a partially written file
+        std::rename(temporary_path.c_str(), metrics.file_path.c_str());
+    }
+
+    // Export the metrics every interval until stopped
+    void runMetricsReporter(LiveMetrics& metrics)
+    {
+        std::unique_lock<std::mutex> lock(metrics.mutex);
+        while (!metrics.stop.wait_for(lock, metrics.interval, [&]{ return metrics.stopping; })) {
+            exportMetrics(metrics);
+        }
+    }
+
+    // Start exporting the metrics to a file every interval
+    void startMetricsReporter(LiveMetrics& metrics, std::string const& file_path, uint32_t const& interval_ms)
+    {
+        metrics.file_path = file_path;
+        metrics.interval = std::chrono::milliseconds(std::max<uint32_t>(interval_ms, 1));
+        metrics.last_export = std::chrono::steady_clock::now();
+        exportMetrics(metrics);
+
+        metrics.thread = std::thread(runMetricsReporter, std::ref(metrics));
+    }
+
+    // Stop the reporter after a last export
+    void stopMetricsReporter(LiveMetrics& metrics)
+    {
+        if (!metrics.thread.joinable()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(metrics.mutex);
+            metrics.stopping = true;
+        }
+        metrics.stop.notify_one();
+        metrics.thread.join();
+
+        exportMetrics(metrics);
+    }
+
+} // namespace cfm
+
+#endif // METRICS_H
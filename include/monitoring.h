@@ -1,44 +1,56 @@
 #ifndef MONITORING_H
 #define MONITORING_H
 
-#include "cfmodel.h"
-#include <iterator> // iterator, next
+#include "signatures.h"
+#include "kernels.h"
+#include "metrics.h"
+#include "scheduler.h"
 
 namespace cfm
 {
 
-    // Compute a map's right to left cumulative sum
-    template<class T1, class T2>
-    std::map<T1, T2> computeMapCumulativeSum(const std::map<T1, T2>& map_data)
+    // Compute a map's right to left cumulative sum in place
+    template<class Map>
+    void computeMapCumulativeSum(Map& map_data)
     {
-        std::map<T1, T2> map_data_temp = map_data;
-        for (auto it = std::next(map_data_temp.rbegin(), +1); it != map_data_temp.rend(); ++it) {
-            auto tau_right = std::next(it, -1)->second;
-            map_data_temp[it->first] += tau_right;
+        typename Map::mapped_type tau_right = 0;
+        for (auto it = map_data.rbegin(); it != map_data.rend(); ++it) {
+            it->second += tau_right;
+            tau_right = it->second;
         }
+    }
 
-        return map_data_temp;
+    // Sum a map's values from a key onwards, equal to its cumulative sum at the key's lower bound
+    template<class Map>
+    typename Map::mapped_type sumMapFromKey(const Map& map_data, typename Map::key_type const& key)
+    {
+        typename Map::mapped_type sum = 0;
+        for (auto it = map_data.lower_bound(key); it != map_data.end(); ++it) {
+            sum += it->second;
+        }
+
+        return sum;
     }
 
     // Compute activation tau based on the calibration samples
-    uint16_t computeActivationTau(Agents& agents, uint16_t const& n_presenters, const std::vector<std::map<uint16_t, uint32_t>>& calibration_taus_map, uint16_t const& n_calibration_samples)
+    uint16_t computeActivationTau(Agents& agents, uint16_t const& n_presenters, const std::vector<TausMap>& calibration_taus_map, uint16_t const& n_calibration_samples)
     {
         // Aggregate all the detectors' taus maps into one map
         std::map<uint16_t, float> aggregate_taus_map;
-        const std::vector<uint16_t> detectors_ids = {agents.id.begin() + n_presenters, agents.id.end()};
-        for (auto const& id : detectors_ids) {
+        for (uint16_t id = n_presenters; id < agents.id.size(); ++id) {
             for (auto const& kv : calibration_taus_map.at(id)) {
                 aggregate_taus_map[kv.first] += kv.second;
             }
         }
 
         // Cumulative sum of taus
-        aggregate_taus_map = computeMapCumulativeSum(aggregate_taus_map);
+        computeMapCumulativeSum(aggregate_taus_map);
 
         // Average of taus per sample per agent considered for the calibration
+        uint16_t const n_detectors = agents.id.size() - n_presenters;
         for (auto& kv : aggregate_taus_map) {
             kv.second /= n_calibration_samples;
-            kv.second /= detectors_ids.size();
+            kv.second /= n_detectors;
 
             // Find the first activation tau that meets criteria
             if (kv.second < 1) {
@@ -49,22 +61,23 @@ namespace cfm
         return aggregate_taus_map.rbegin()->first;
     }
 
-    // Register the number of pairings for the activation tau after the monitoring of a sample
-    void getNumberPairingsForActivationTau(Agents& agents, uint16_t const& n_presenters, std::vector<std::vector<uint32_t>>& number_pairings, uint16_t const& activation_tau)
+    // Register the number of pairings for the activation tau after the monitoring of a sample into its slots of the detectors' lists
+    void getNumberPairingsForActivationTau(Agents& agents, uint16_t const& n_presenters, std::vector<std::vector<uint32_t>>& number_pairings, uint16_t const& activation_tau, uint32_t const& slot, uint16_t const& multiplicity = 1)
     {
         // Loop through detectors
-        const std::vector<uint16_t> detectors_ids = {agents.id.begin() + n_presenters, agents.id.end()};
-        for (auto const& id : detectors_ids) {
+        for (uint16_t id = n_presenters; id < agents.id.size(); ++id) {
             // Cumulative sum of taus
-            agents.taus_map.at(id) = computeMapCumulativeSum(agents.taus_map.at(id));
+            computeMapCumulativeSum(agents.taus_map.at(id));
 
             // Get the number of pairings for the activation tau, otherwise its zero
+            uint32_t pairings = 0;
             auto it = agents.taus_map.at(id).lower_bound(activation_tau);
             if (it != agents.taus_map.at(id).end()) {
-                number_pairings.at(id - n_presenters).push_back(it->second);
-            } else {
-                number_pairings.at(id - n_presenters).push_back(0);
+                pairings = it->second;
             }
+
+            std::vector<uint32_t>& row = number_pairings.at(id - n_presenters);
+            std::fill(row.begin() + slot, row.begin() + slot + multiplicity, pairings);
         }
     }
 
@@ -78,8 +91,7 @@ namespace cfm
         }
 
         // Compute each detector's activation threshold
-        const std::vector<uint16_t> detectors_ids = {agents.id.begin() + n_presenters, agents.id.end()};
-        for (auto const& id : detectors_ids) {
+        for (uint16_t id = n_presenters; id < agents.id.size(); ++id) {
             agents.activation_thresholds.at(id) = number_pairings_sorted.at(id - n_presenters).at((uint16_t)((n_normal_samples - 1) * (float)activation_threshold_percent / 100));
         }
     }
@@ -91,19 +103,9 @@ namespace cfm
         uint32_t response_sum = 0;
 
         // Loop through detectors
-        const std::vector<uint16_t> detectors_ids = {agents.id.begin() + n_presenters, agents.id.end()};
-        for (auto const& id : detectors_ids) {
-
-            // Cumulative sum of taus
-            std::map<uint16_t, uint32_t> agent_taus_map_temp = agents.taus_map.at(id);
-            agent_taus_map_temp = computeMapCumulativeSum(agent_taus_map_temp);
-
-            // Get the number of pairings for the activation tau, otherwise its zero
-            auto it = agent_taus_map_temp.lower_bound(activation_tau);
-            uint32_t number_pairings = 0;
-            if (it != agent_taus_map_temp.end()) {
-                number_pairings = it->second;
-            }
+        for (uint16_t id = n_presenters; id < agents.id.size(); ++id) {
+            // Get the number of pairings for the activation tau from the cumulative sum of taus, otherwise its zero
+            uint32_t number_pairings = sumMapFromKey(agents.taus_map.at(id), activation_tau);
 
             // Compute individual response and add it to collective response
             response_sum += (number_pairings - agents.activation_thresholds.at(id)) * (number_pairings > agents.activation_thresholds.at(id));
@@ -113,37 +115,215 @@ namespace cfm
     }
 
     // Cellular frustration dynamics with trained detectors that monitor test samples
-    void monitoring(Agents& agents, uint16_t const& n_presenters, uint32_t const& frustration_rounds, uint16_t const& n_features, const std::vector<float>& sample, uint16_t const& seed = 0)
+    void monitoring(Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint32_t const& frustration_rounds, uint16_t const& n_features, const std::vector<float>& sample, uint16_t const& seed = 0, SignatureIndex const* signature_index = nullptr)
     {
         // Initialize random number generator
         std::mt19937 generator(seed);
 
-        // Initialize interactions queue (indices = priority; elements = interaction pairs)
-        std::vector<uint16_t> interactions_queue(n_presenters);
-        std::iota(interactions_queue.begin(), interactions_queue.end(), 0);
+        // Initialize interactions queue and pairs
+        resetWorkspaceInteractions(workspace, n_presenters, agents.id.size() - n_presenters);
+
+        // The sample is fixed, so its signals and local lists are mapped only once
+        if (signature_index != nullptr) {
+            mapSampleToPresentersSignals(agents, n_presenters, n_features, sample);
+            computeSampleSignature(*signature_index, sample, workspace.signature);
+            mapSignatureToDetectorsLocalLists(agents, *signature_index, n_presenters, n_features, workspace.signature, workspace.signal_out);
+        } else {
+            changeSampleDispatch(agents, workspace, n_presenters, n_features, sample);
+        }
 
-        // Initialize interaction pairs (indices = presenters' ids; elements = detectors' ids)
-        std::vector<uint16_t> interaction_pairs(n_presenters);
-        std::iota(interaction_pairs.begin(), interaction_pairs.end(), n_presenters);
+        uint64_t const allocations_before = getAllocationCount();
 
         // Main loop
         for (uint32_t round = 0; round < frustration_rounds; ++round) {
-            changeSample(agents, n_presenters, n_features, sample);
+            agents.lazy.round = round;
 
             // Loop through interactions between pairs of agents
-            interactions(generator, agents, n_presenters, interactions_queue, interaction_pairs);
+            runInteractions(generator, agents, n_presenters, workspace);
 
             // Randomly dissociate agents
-            dissociation(generator, agents);
+            dissociation(generator, agents, workspace);
 
-            // Update agents' metrics
-            updateAgentsMetrics(agents);
+            // Update agents' metrics, lazy lifetimes come from the rounds their matches started
+            if (!agents.lazy.enabled) {
+                updateAgentsMetrics(agents);
+            }
         }
+        agents.lazy.round = frustration_rounds;
 
         // Register taus on last round
         for (auto const& id : agents.id) {
-            ++agents.taus_map.at(id)[agents.tau.at(id)];
+            registerAgentTau(agents, id);
+        }
+
+        registerHotPathAllocations(workspace, allocations_before);
+
+        // Counted once per sample so worker threads rarely touch the shared counters
+        addMetricsSample(workspace.metrics, frustration_rounds);
+    }
+
+    // Accumulate detectors' taus maps in place, as registering their number of pairings does
+    void accumulateDetectorsTausMaps(Agents& agents, uint16_t const& n_presenters)
+    {
+        for (uint16_t id = n_presenters; id < agents.id.size(); ++id) {
+            computeMapCumulativeSum(agents.taus_map.at(id));
+        }
+    }
+
+    // Monitor a test sample and compute the detectors' collective response towards it
+    uint32_t scoreSample(Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint32_t const& monitoring_rounds, uint16_t const& n_features, const std::vector<float>& sample, uint16_t const& activation_tau, SignatureIndex const* signature_index = nullptr)
+    {
+        // The response only reads detectors' lifetimes from the activation tau upwards
+        enableLazyTaus(agents, n_presenters, activation_tau);
+        monitoring(agents, workspace, n_presenters, monitoring_rounds, n_features, sample, 0, signature_index);
+        disableLazyTaus(agents);
+
+        // Responses have always been computed after registering the number of pairings, so they read the cumulative
+        // sum of the lifetimes' cumulative sums (see LazyTaus)
+        accumulateDetectorsTausMaps(agents, n_presenters);
+
+        // Compute response to sample
+        uint32_t response = computeCollectiveResponse(agents, n_presenters, activation_tau);
+
+        // Reset some of the agents' data structures
+        resetAgentsMatch(agents);
+        resetAgentsTau(agents);
+        resetAgentsTausMap(agents);
+
+        return response;
+    }
+
+    // Simulation state owned by one worker thread
+    struct WorkerState
+    {
+        Agents agents;
+        Workspace workspace;
+    };
+
+    // Copy the simulation state for every worker, a single worker uses the caller's state directly
+    std::vector<WorkerState> initWorkerStates(Agents const& agents, Workspace const& workspace, uint16_t const& n_workers)
+    {
+        std::vector<WorkerState> states;
+        if (n_workers > 1) {
+            states.resize(n_workers, WorkerState{agents, workspace});
+
+            // Round workers belong to the caller's thread
+            for (auto& state : states) {
+                state.workspace.round_workers = nullptr;
+            }
         }
+
+        return states;
+    }
+
+    // Calibrate the activation tau and the detectors' activation thresholds with normal samples, each simulated sample standing for its multiplicity of equivalent normal samples, and optionally keep their number of pairings
+    uint16_t calibration(Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint32_t const& monitoring_rounds, uint16_t const& n_features, const std::vector<std::vector<float>>& samples, const std::vector<uint16_t>& normal_multiplicity, uint16_t const& activation_threshold_percent, SignatureIndex const& signature_index, uint16_t const& n_threads = 1, std::vector<std::vector<uint32_t>>* normal_pairings = nullptr)
+    {
+        uint16_t const n_detectors = agents.id.size() - n_presenters;
+
+        // Simulated samples and the first slot of their number of pairings
+        std::vector<uint16_t> calibration_samples;
+        std::vector<uint32_t> slots;
+        uint16_t n_normal_samples = 0;
+        for (uint16_t i = 0; i < samples.size(); ++i) {
+            if (normal_multiplicity.at(i) > 0) {
+                calibration_samples.push_back(i);
+                slots.push_back(n_normal_samples);
+                n_normal_samples += normal_multiplicity.at(i);
+            }
+        }
+
+        // Workers' simulation states
+        uint16_t const n_workers = std::max<std::size_t>(1, std::min<std::size_t>(n_threads, calibration_samples.size()));
+        std::vector<WorkerState> states = initWorkerStates(agents, workspace, n_workers);
+
+        // All registered taus across each worker's calibration samples
+        std::vector<std::vector<TausMap>> workers_taus_map(n_workers, std::vector<TausMap>(agents.id.size()));
+
+        // Activation tau calibration with normal samples
+        runWorkStealing(n_workers, calibration_samples.size(), [&](uint16_t const worker, uint32_t const task) {
+            Agents& worker_agents = n_workers > 1 ? states[worker].agents : agents;
+            Workspace& worker_workspace = n_workers > 1 ? states[worker].workspace : workspace;
+            uint16_t const i = calibration_samples[task];
+
+            // The activation tau only reads detectors' lifetimes
+            enableLazyTaus(worker_agents, n_presenters, 0);
+            monitoring(worker_agents, worker_workspace, n_presenters, monitoring_rounds, n_features, samples.at(i), 0, &signature_index);
+            disableLazyTaus(worker_agents);
+
+            // Register calibration taus once for every equivalent normal sample
+            for (auto const& id : worker_agents.id) {
+                for (auto const& kv : worker_agents.taus_map.at(id)) {
+                    workers_taus_map[worker].at(id)[kv.first] += kv.second * normal_multiplicity.at(i);
+                }
+            }
+
+            // Reset some of the agents' data structures
+            resetAgentsMatch(worker_agents);
+            resetAgentsTau(worker_agents);
+            resetAgentsTausMap(worker_agents);
+        });
+
+        // Merge the workers' taus
+        std::vector<TausMap>& calibration_taus_map = workers_taus_map.at(0);
+        for (uint16_t worker = 1; worker < n_workers; ++worker) {
+            for (auto const& id : agents.id) {
+                for (auto const& kv : workers_taus_map.at(worker).at(id)) {
+                    calibration_taus_map.at(id)[kv.first] += kv.second;
+                }
+            }
+        }
+
+        // Compute activation tau
+        uint16_t activation_tau = computeActivationTau(agents, n_presenters, calibration_taus_map, n_normal_samples);
+        workers_taus_map.clear();
+
+        // All number of pairings for the activation tau for all normal samples
+        std::vector<std::vector<uint32_t>> number_pairings(n_detectors, std::vector<uint32_t>(n_normal_samples));
+
+        // Activation threshold calibration with normal samples
+        runWorkStealing(n_workers, calibration_samples.size(), [&](uint16_t const worker, uint32_t const task) {
+            Agents& worker_agents = n_workers > 1 ? states[worker].agents : agents;
+            Workspace& worker_workspace = n_workers > 1 ? states[worker].workspace : workspace;
+            uint16_t const i = calibration_samples[task];
+
+            // The number of pairings only reads detectors' lifetimes from the activation tau upwards
+            enableLazyTaus(worker_agents, n_presenters, activation_tau);
+            monitoring(worker_agents, worker_workspace, n_presenters, monitoring_rounds, n_features, samples.at(i), 0, &signature_index);
+            disableLazyTaus(worker_agents);
+
+            // Register the number of pairings for the activation tau, shared by equivalent normal samples
+            getNumberPairingsForActivationTau(worker_agents, n_presenters, number_pairings, activation_tau, slots[task], normal_multiplicity.at(i));
+
+            // Reset some of the agents' data structures
+            resetAgentsMatch(worker_agents);
+            resetAgentsTau(worker_agents);
+            resetAgentsTausMap(worker_agents);
+        });
+
+        // Compute activation threshold for each detector
+        computeActivationThresholds(agents, n_presenters, number_pairings, activation_threshold_percent, n_normal_samples);
+
+        if (normal_pairings != nullptr) {
+            *normal_pairings = std::move(number_pairings);
+        }
+
+        return activation_tau;
+    }
+
+    // Score samples into their slots of the responses, spreading them over worker threads
+    void scoreSamples(Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint32_t const& monitoring_rounds, uint16_t const& n_features, const std::vector<std::vector<float>>& samples, const std::vector<uint16_t>& sample_ids, uint16_t const& activation_tau, SignatureIndex const& signature_index, std::vector<uint32_t>& responses, uint16_t const& n_threads = 1)
+    {
+        uint16_t const n_workers = std::max<std::size_t>(1, std::min<std::size_t>(n_threads, sample_ids.size()));
+        std::vector<WorkerState> states = initWorkerStates(agents, workspace, n_workers);
+
+        runWorkStealing(n_workers, sample_ids.size(), [&](uint16_t const worker, uint32_t const task) {
+            Agents& worker_agents = n_workers > 1 ? states[worker].agents : agents;
+            Workspace& worker_workspace = n_workers > 1 ? states[worker].workspace : workspace;
+            uint16_t const i = sample_ids[task];
+
+            responses[i] = scoreSample(worker_agents, worker_workspace, n_presenters, monitoring_rounds, n_features, samples.at(i), activation_tau, &signature_index);
+        });
     }
 
 } // namespace cfm
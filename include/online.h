@@ -0,0 +1,170 @@
+#ifndef ONLINE_H
+#define ONLINE_H
+
+#include "monitoring.h"
+#include "sketch.h"
+
+namespace cfm
+{
+
+    // Detectors' activation thresholds tracking the number of pairings of confirmed normal samples as they stream in
+    struct OnlineCalibration
+    {
+        // Quantile sketch of each detector's number of pairings for normal samples
+        std::vector<QuantileSketch> sketches;
+
+        uint16_t activation_threshold_percent = 0;
+
+        // Weight of the latest normal samples, grown by each new one so older ones fade (decay 1 keeps every sample alike)
+        double unit_weight = 1;
+        double decay = 1;
+
+        // Normal samples registered so far
+        uint32_t n_normal = 0;
+    };
+
+    // Weights are renormalized past this unit weight
+    double const ONLINE_MAX_UNIT_WEIGHT = 1e100;
+
+    // Start an online calibration from the number of pairings of the offline calibration's normal samples, and let older
+    // samples weigh half as much after half_life newer ones (0 never forgets them)
+    OnlineCalibration initOnlineCalibration(const std::vector<std::vector<uint32_t>>& number_pairings, uint16_t const& activation_threshold_percent, uint32_t const& half_life)
+    {
+        OnlineCalibration online;
+        online.sketches.resize(number_pairings.size());
+        online.activation_threshold_percent = activation_threshold_percent;
+        online.decay = half_life > 0 ? std::pow(0.5, 1.0 / half_life) : 1;
+
+        for (uint16_t d = 0; d < number_pairings.size(); ++d) {
+            for (auto const& pairings : number_pairings.at(d)) {
+                insertQuantileSketch(online.sketches.at(d), pairings);
+            }
+        }
+        online.n_normal = number_pairings.empty() ? 0 : number_pairings.front().size();
+
+        return online;
+    }
+
+    // Merge sketches of normal samples seen at the same time, then move the thresholds to their new quantiles
+    void updateOnlineCalibration(Agents& agents, uint16_t const& n_presenters, OnlineCalibration& online, const std::vector<QuantileSketch>& sketches, uint32_t const& n_normal)
+    {
+        if (n_normal == 0) {
+            return;
+        }
+
+        for (uint16_t d = 0; d < online.sketches.size(); ++d) {
+            mergeQuantileSketch(online.sketches.at(d), sketches.at(d), online.unit_weight);
+        }
+        online.n_normal += n_normal;
+
+        // Later samples weigh more instead of decaying every older weight
+        online.unit_weight /= std::pow(online.decay, n_normal);
+        if (online.unit_weight > ONLINE_MAX_UNIT_WEIGHT) {
+            for (auto& sketch : online.sketches) {
+                scaleQuantileSketch(sketch, 1 / online.unit_weight);
+            }
+            online.unit_weight = 1;
+        }
+
+        for (uint16_t d = 0; d < online.sketches.size(); ++d) {
+            agents.activation_thresholds.at(n_presenters + d) = getSketchUpperQuantile(online.sketches.at(d), online.activation_threshold_percent, online.unit_weight);
+        }
+    }
+
+    // Monitor a sample and get each detector's number of pairings for the activation tau, as scoreSample reads them, and
+    // optionally as the calibration counts them (pairings lasting at least the activation tau, which the thresholds are
+    // quantiles of)
+    void monitorNumberPairings(Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint32_t const& monitoring_rounds, uint16_t const& n_features, const std::vector<float>& sample, uint16_t const& activation_tau, SignatureIndex const& signature_index, std::vector<uint32_t>& number_pairings, std::vector<uint32_t>* calibration_pairings = nullptr)
+    {
+        enableLazyTaus(agents, n_presenters, activation_tau);
+        monitoring(agents, workspace, n_presenters, monitoring_rounds, n_features, sample, 0, &signature_index);
+        disableLazyTaus(agents);
+
+        if (calibration_pairings != nullptr) {
+            for (uint16_t id = n_presenters; id < agents.id.size(); ++id) {
+                calibration_pairings->at(id - n_presenters) = sumMapFromKey(agents.taus_map.at(id), activation_tau);
+            }
+        }
+
+        // Same pairings as scoreSample reads
+        accumulateDetectorsTausMaps(agents, n_presenters);
+
+        for (uint16_t id = n_presenters; id < agents.id.size(); ++id) {
+            number_pairings.at(id - n_presenters) = sumMapFromKey(agents.taus_map.at(id), activation_tau);
+        }
+
+        // Reset some of the agents' data structures
+        resetAgentsMatch(agents);
+        resetAgentsTau(agents);
+        resetAgentsTausMap(agents);
+    }
+
+    // Score samples in stream order, each batch with the thresholds left by the earlier ones, then let the batch's
+    // confirmed normal samples (class -1) move the thresholds. The first n_seeded samples already started the online
+    // calibration, so they are scored without being registered again
+    void scoreSamplesOnline(Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint32_t const& monitoring_rounds, uint16_t const& n_features, const std::vector<std::vector<float>>& samples, const std::vector<int16_t>& classes, uint16_t const& activation_tau, SignatureIndex const& signature_index, OnlineCalibration& online, uint32_t const& batch_size, std::vector<uint32_t>& responses, uint32_t const& n_seeded = 0, uint16_t const& n_threads = 1)
+    {
+        uint16_t const n_detectors = agents.id.size() - n_presenters;
+        uint32_t const n_batch = std::max<uint32_t>(batch_size, 1);
+
+        uint16_t const n_workers = std::max<std::size_t>(1, std::min<std::size_t>(n_threads, std::min<std::size_t>(n_batch, samples.size())));
+        std::vector<WorkerState> states = initWorkerStates(agents, workspace, n_workers);
+
+        // Each worker sketches its own normal samples, merged once the batch is done
+        std::vector<std::vector<QuantileSketch>> worker_sketches(n_workers);
+        std::vector<uint32_t> worker_normal(n_workers);
+
+        // Number of pairings of each sample of the batch, for its response and for the calibration
+        std::vector<std::vector<uint32_t>> batch_pairings(n_batch, std::vector<uint32_t>(n_detectors));
+        std::vector<std::vector<uint32_t>> batch_calibration_pairings(n_batch, std::vector<uint32_t>(n_detectors));
+
+        for (uint32_t first = 0; first < samples.size(); first += n_batch) {
+            uint32_t const last = std::min<uint32_t>(samples.size(), first + n_batch);
+
+            for (uint16_t w = 0; w < n_workers; ++w) {
+                worker_sketches[w].assign(n_detectors, QuantileSketch());
+                worker_normal[w] = 0;
+            }
+
+            runWorkStealing(n_workers, last - first, [&](uint16_t const worker, uint32_t const task) {
+                Agents& worker_agents = n_workers > 1 ? states[worker].agents : agents;
+                Workspace& worker_workspace = n_workers > 1 ? states[worker].workspace : workspace;
+                std::vector<uint32_t>& calibration_pairings = batch_calibration_pairings[task];
+                bool const registered = classes[first + task] == -1 && first + task >= n_seeded;
+
+                monitorNumberPairings(worker_agents, worker_workspace, n_presenters, monitoring_rounds, n_features, samples[first + task], activation_tau, signature_index, batch_pairings[task], registered ? &calibration_pairings : nullptr);
+
+                if (registered) {
+                    for (uint16_t d = 0; d < n_detectors; ++d) {
+                        insertQuantileSketch(worker_sketches[worker][d], calibration_pairings[d]);
+                    }
+                    ++worker_normal[worker];
+                }
+            });
+
+            // Responses with the thresholds in place when the batch arrived
+            for (uint32_t i = first; i < last; ++i) {
+                uint32_t response = 0;
+                for (uint16_t d = 0; d < n_detectors; ++d) {
+                    uint32_t const pairings = batch_pairings[i - first][d];
+                    uint32_t const threshold = agents.activation_thresholds.at(n_presenters + d);
+                    response += (pairings - threshold) * (pairings > threshold);
+                }
+                responses.at(i) = response;
+            }
+
+            // Workers' sketches of the batch
+            std::vector<QuantileSketch>& batch_sketches = worker_sketches[0];
+            for (uint16_t w = 1; w < n_workers; ++w) {
+                for (uint16_t d = 0; d < n_detectors; ++d) {
+                    mergeQuantileSketch(batch_sketches[d], worker_sketches[w][d]);
+                }
+                worker_normal[0] += worker_normal[w];
+            }
+            updateOnlineCalibration(agents, n_presenters, online, batch_sketches, worker_normal[0]);
+        }
+    }
+
+} // namespace cfm
+
+#endif // ONLINE_H
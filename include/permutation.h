@@ -0,0 +1,71 @@
+#ifndef PERMUTATION_H
+#define PERMUTATION_H
+
+#include "workspace.h"
+#include <random>   // mt19937
+
+namespace cfm
+{
+
+    // Map a random word to a uniform integer below range, dividing only when the word lands in the biased zone
+    uint32_t getBoundedRandom(std::mt19937& generator, uint32_t word, uint32_t const& range)
+    {
+        uint64_t product = (uint64_t)word * range;
+        uint32_t low = (uint32_t)product;
+        if (low < range) {
+            uint32_t const threshold = (0u - range) % range;
+            while (low < threshold) {
+                word = (uint32_t)generator();
+                product = (uint64_t)word * range;
+                low = (uint32_t)product;
+            }
+        }
+
+        return product >> 32;
+    }
+
+    // SplitMix64 output for a counter, so a round's words are independent of each other and drawn without a serial state
+    uint64_t getSplitMixWord(uint64_t const& seed, uint64_t const& counter)
+    {
+        uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Shuffle the interactions queue and pairs with one Fisher-Yates pass over both, drawing all random words up front
+    void shuffleInteractionsFast(std::mt19937& generator, Workspace& workspace)
+    {
+        std::vector<uint16_t>& queue = workspace.interactions_queue;
+        std::vector<uint16_t>& pairs = workspace.interaction_pairs;
+        std::vector<uint64_t>& words = workspace.random_words;
+
+        // Only the round's seed comes from the model's generator, each word then holds a draw for the queue and one for the pairs
+        uint64_t const seed = ((uint64_t)generator() << 32) | (uint32_t)generator();
+        for (uint32_t i = 0; i < words.size(); ++i) {
+            words[i] = getSplitMixWord(seed, i);
+        }
+
+        for (uint32_t n = queue.size(); n > 1; --n) {
+            uint64_t const word = words[n - 1];
+            std::swap(queue[n - 1], queue[getBoundedRandom(generator, (uint32_t)word, n)]);
+            std::swap(pairs[n - 1], pairs[getBoundedRandom(generator, word >> 32, n)]);
+        }
+    }
+
+    // Shuffle the interactions queue and pairs of a round
+    void shuffleInteractions(std::mt19937& generator, Workspace& workspace)
+    {
+        if (workspace.fast_shuffle) {
+            shuffleInteractionsFast(generator, workspace);
+            return;
+        }
+
+        // Legacy draws, reproducing earlier results
+        std::shuffle(workspace.interactions_queue.begin(), workspace.interactions_queue.end(), generator);
+        std::shuffle(workspace.interaction_pairs.begin(), workspace.interaction_pairs.end(), generator);
+    }
+
+} // namespace cfm
+
+#endif // PERMUTATION_H
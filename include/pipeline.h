@@ -0,0 +1,115 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "kernels.h"
+#include <condition_variable>   // condition_variable
+#include <mutex>                // mutex, unique_lock, lock_guard
+#include <thread>               // thread
+
+namespace cfm
+{
+
+    // Helper thread preparing the next sample's signals and detectors' local lists while the current sample's rounds run
+    struct SamplePipeline
+    {
+        // Agents holding only the staged sample's signals and local lists
+        Agents staged;
+
+        // Scratch storage of the helper thread
+        Workspace workspace;
+
+        uint16_t n_presenters = 0;
+        uint16_t n_features = 0;
+
+        // Sample to prepare next
+        std::vector<float> const* sample = nullptr;
+
+        bool requested = false;
+        bool ready = false;
+        bool closing = false;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::thread thread;
+    };
+
+    // Prepare requested samples until the pipeline is closed
+    void runSamplePipeline(SamplePipeline& pipeline)
+    {
+        std::unique_lock<std::mutex> lock(pipeline.mutex);
+        while (true) {
+            pipeline.wake.wait(lock, [&]{ return pipeline.closing || pipeline.requested; });
+            if (pipeline.closing) {
+                break;
+            }
+            pipeline.requested = false;
+            std::vector<float> const& sample = *pipeline.sample;
+            lock.unlock();
+
+            // Only the staged buffers are written, so the rounds keep running on the agents
+            changeSampleDispatch(pipeline.staged, pipeline.workspace, pipeline.n_presenters, pipeline.n_features, sample);
+
+            lock.lock();
+            pipeline.ready = true;
+            pipeline.wake.notify_all();
+        }
+    }
+
+    // Stage copies of the agents' sample buffers and start the helper thread
+    void openSamplePipeline(SamplePipeline& pipeline, Agents const& agents, uint16_t const& n_presenters, uint16_t const& n_features)
+    {
+        // Detectors' signals and presenters' local lists never change, so both buffers keep them
+        pipeline.staged.id = agents.id;
+        pipeline.staged.signal = agents.signal;
+        pipeline.staged.local_list = agents.local_list;
+        pipeline.staged.left_criticals = agents.left_criticals;
+        pipeline.staged.right_criticals = agents.right_criticals;
+
+        pipeline.workspace = initWorkspace(agents.id.size(), n_presenters, n_features);
+        pipeline.n_presenters = n_presenters;
+        pipeline.n_features = n_features;
+
+        pipeline.thread = std::thread(runSamplePipeline, std::ref(pipeline));
+    }
+
+    // Ask the helper thread to prepare a sample
+    void requestSample(SamplePipeline& pipeline, std::vector<float> const& sample)
+    {
+        {
+            std::lock_guard<std::mutex> lock(pipeline.mutex);
+            pipeline.sample = &sample;
+            pipeline.requested = true;
+            pipeline.ready = false;
+        }
+        pipeline.wake.notify_all();
+    }
+
+    // Wait for the requested sample and swap its buffers into the agents
+    void swapSample(SamplePipeline& pipeline, Agents& agents)
+    {
+        std::unique_lock<std::mutex> lock(pipeline.mutex);
+        pipeline.wake.wait(lock, [&]{ return pipeline.ready; });
+        pipeline.ready = false;
+
+        std::swap(agents.signal, pipeline.staged.signal);
+        std::swap(agents.local_list, pipeline.staged.local_list);
+    }
+
+    // Stop the helper thread, a requested sample not yet swapped is dropped
+    void closeSamplePipeline(SamplePipeline& pipeline)
+    {
+        if (!pipeline.thread.joinable()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(pipeline.mutex);
+            pipeline.closing = true;
+        }
+        pipeline.wake.notify_all();
+        pipeline.thread.join();
+    }
+
+} // namespace cfm
+
+#endif // PIPELINE_H
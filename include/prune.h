@@ -0,0 +1,258 @@
+#ifndef PRUNE_H
+#define PRUNE_H
+
+#include "online.h"
+
+namespace cfm
+{
+
+    // Outcome of a detectors' pruning
+    struct PruningReport
+    {
+        uint16_t n_detectors = 0;
+        uint16_t n_kept = 0;
+
+        // AUC of the test responses with all the detectors and with the kept ones once recalibrated
+        double auc = 0;
+        double pruned_auc = 0;
+
+        // Pruned models simulated to validate the AUC
+        uint16_t n_evaluated = 0;
+    };
+
+    // Area under the ROC curve of the responses to normal (-1) and anomalous samples, ties counting half
+    double computeAUC(const std::vector<uint64_t>& responses, const std::vector<int16_t>& classes)
+    {
+        std::vector<uint32_t> order(responses.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](uint32_t const a, uint32_t const b) { return responses[a] < responses[b]; });
+
+        double n_normal = 0;
+        double n_anomalous = 0;
+        double area = 0;
+        for (std::size_t first = 0; first < order.size();) {
+            // Samples sharing a response
+            std::size_t last = first;
+            double tied_normal = 0;
+            double tied_anomalous = 0;
+            while (last < order.size() && responses[order[last]] == responses[order[first]]) {
+                if (classes[order[last]] == -1) {
+                    ++tied_normal;
+                } else {
+                    ++tied_anomalous;
+                }
+                ++last;
+            }
+
+            // Anomalous samples outrank the normal samples below them and half of the tied ones
+            area += tied_anomalous * (n_normal + tied_normal / 2);
+            n_normal += tied_normal;
+            n_anomalous += tied_anomalous;
+            first = last;
+        }
+
+        if (n_normal == 0 || n_anomalous == 0) {
+            return 0.5;
+        }
+
+        return area / (n_normal * n_anomalous);
+    }
+
+    // Get the detectors' number of pairings for the activation tau of every sample, simulating only the first sample of each signature
+    std::vector<std::vector<uint32_t>> getSamplesNumberPairings(Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint32_t const& monitoring_rounds, uint16_t const& n_features, const std::vector<std::vector<float>>& samples, const std::vector<uint16_t>& equivalent_samples, uint16_t const& activation_tau, SignatureIndex const& signature_index, uint16_t const& n_threads = 1)
+    {
+        std::vector<uint16_t> simulated_samples;
+        for (uint16_t i = 0; i < samples.size(); ++i) {
+            if (equivalent_samples.at(i) == i) {
+                simulated_samples.push_back(i);
+            }
+        }
+
+        std::vector<std::vector<uint32_t>> number_pairings(samples.size(), std::vector<uint32_t>(agents.id.size() - n_presenters));
+
+        uint16_t const n_workers = std::max<std::size_t>(1, std::min<std::size_t>(n_threads, simulated_samples.size()));
+        std::vector<WorkerState> states = initWorkerStates(agents, workspace, n_workers);
+
+        runWorkStealing(n_workers, simulated_samples.size(), [&](uint16_t const worker, uint32_t const task) {
+            Agents& worker_agents = n_workers > 1 ? states[worker].agents : agents;
+            Workspace& worker_workspace = n_workers > 1 ? states[worker].workspace : workspace;
+            uint16_t const i = simulated_samples[task];
+
+            monitorNumberPairings(worker_agents, worker_workspace, n_presenters, monitoring_rounds, n_features, samples[i], activation_tau, signature_index, number_pairings[i]);
+        });
+
+        for (uint16_t i = 0; i < samples.size(); ++i) {
+            number_pairings.at(i) = number_pairings.at(equivalent_samples.at(i));
+        }
+
+        return number_pairings;
+    }
+
+    // Each detector's share of the response to each sample, as computeCollectiveResponse adds them up
+    std::vector<std::vector<uint32_t>> getDetectorsContributions(Agents const& agents, uint16_t const& n_presenters, const std::vector<std::vector<uint32_t>>& number_pairings)
+    {
+        uint16_t const n_detectors = agents.id.size() - n_presenters;
+        std::vector<std::vector<uint32_t>> contributions(n_detectors, std::vector<uint32_t>(number_pairings.size()));
+
+        for (uint16_t d = 0; d < n_detectors; ++d) {
+            uint32_t const threshold = agents.activation_thresholds.at(n_presenters + d);
+            for (uint32_t i = 0; i < number_pairings.size(); ++i) {
+                uint32_t const pairings = number_pairings.at(i).at(d);
+                contributions.at(d).at(i) = (pairings - threshold) * (pairings > threshold);
+            }
+        }
+
+        return contributions;
+    }
+
+    // Responses of the given detectors, summing their contributions
+    std::vector<uint64_t> sumContributions(const std::vector<std::vector<uint32_t>>& contributions, const std::vector<uint16_t>& detectors, uint32_t const& n_samples)
+    {
+        std::vector<uint64_t> responses(n_samples);
+        for (auto const& d : detectors) {
+            for (uint32_t i = 0; i < n_samples; ++i) {
+                responses.at(i) += contributions.at(d).at(i);
+            }
+        }
+
+        return responses;
+    }
+
+    // Order in which detectors are dropped: detectors separating anomalous from normal samples the least come first, and
+    // only those whose contributions can be removed without the AUC of the others falling below min_auc are listed
+    std::vector<uint16_t> rankDroppedDetectors(const std::vector<std::vector<uint32_t>>& contributions, const std::vector<int16_t>& classes, double const& min_auc)
+    {
+        uint16_t const n_detectors = contributions.size();
+        uint32_t const n_samples = classes.size();
+
+        // Separation of each detector: mean contribution to anomalous samples minus mean contribution to normal samples
+        double n_normal = 0;
+        for (auto const& sample_class : classes) {
+            n_normal += sample_class == -1;
+        }
+        double const n_anomalous = n_samples - n_normal;
+        std::vector<double> separations(n_detectors);
+        for (uint16_t d = 0; d < n_detectors; ++d) {
+            double normal_sum = 0;
+            double anomalous_sum = 0;
+            for (uint32_t i = 0; i < n_samples; ++i) {
+                (classes.at(i) == -1 ? normal_sum : anomalous_sum) += contributions.at(d).at(i);
+            }
+            separations.at(d) = (n_anomalous > 0 ? anomalous_sum / n_anomalous : 0) - (n_normal > 0 ? normal_sum / n_normal : 0);
+        }
+
+        std::vector<uint16_t> order(n_detectors);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](uint16_t const a, uint16_t const b) { return separations[a] < separations[b]; });
+
+        // Remove contributions greedily, always keeping one detector
+        std::vector<uint16_t> all_detectors(n_detectors);
+        std::iota(all_detectors.begin(), all_detectors.end(), 0);
+        std::vector<uint64_t> responses = sumContributions(contributions, all_detectors, n_samples);
+        std::vector<uint64_t> pruned_responses(n_samples);
+
+        std::vector<uint16_t> dropped;
+        for (auto const& d : order) {
+            if (dropped.size() + 1 == n_detectors) {
+                break;
+            }
+
+            for (uint32_t i = 0; i < n_samples; ++i) {
+                pruned_responses.at(i) = responses.at(i) - contributions.at(d).at(i);
+            }
+            if (computeAUC(pruned_responses, classes) >= min_auc) {
+                responses.swap(pruned_responses);
+                dropped.push_back(d);
+            }
+        }
+
+        return dropped;
+    }
+
+    // Detectors left once the first n_dropped detectors of the drop order are removed, in ascending order
+    std::vector<uint16_t> getKeptDetectors(uint16_t const& n_detectors, const std::vector<uint16_t>& dropped, uint16_t const& n_dropped)
+    {
+        std::vector<bool> kept(n_detectors, true);
+        for (uint16_t i = 0; i < n_dropped; ++i) {
+            kept.at(dropped.at(i)) = false;
+        }
+
+        std::vector<uint16_t> detectors_kept;
+        for (uint16_t d = 0; d < n_detectors; ++d) {
+            if (kept.at(d)) {
+                detectors_kept.push_back(d);
+            }
+        }
+
+        return detectors_kept;
+    }
+
+    // Recalibrate a model with only the kept detectors and get the AUC of its responses to the test samples
+    double evaluatePrunedModel(Agents const& agents, Workspace const& workspace, uint16_t const& n_presenters, uint32_t const& monitoring_rounds, uint16_t const& n_features, const std::vector<std::vector<float>>& samples, const std::vector<int16_t>& classes, const std::vector<uint16_t>& equivalent_samples, const std::vector<uint16_t>& normal_multiplicity, uint16_t const& activation_threshold_percent, const std::vector<uint16_t>& detectors_kept, uint16_t const& n_threads = 1)
+    {
+        Agents pruned_agents = agents;
+        pruneDetectors(pruned_agents, n_presenters, detectors_kept);
+        SignatureIndex const signature_index = buildSignatureIndex(pruned_agents, n_presenters, n_features);
+
+        Workspace pruned_workspace = workspace;
+        resizeWorkspaceAgents(pruned_workspace, pruned_agents.id.size());
+
+        uint16_t const activation_tau = calibration(pruned_agents, pruned_workspace, n_presenters, monitoring_rounds, n_features, samples, normal_multiplicity, activation_threshold_percent, signature_index, n_threads);
+        const std::vector<std::vector<uint32_t>> number_pairings = getSamplesNumberPairings(pruned_agents, pruned_workspace, n_presenters, monitoring_rounds, n_features, samples, equivalent_samples, activation_tau, signature_index, n_threads);
+        const std::vector<std::vector<uint32_t>> contributions = getDetectorsContributions(pruned_agents, n_presenters, number_pairings);
+
+        std::vector<uint16_t> all_detectors(detectors_kept.size());
+        std::iota(all_detectors.begin(), all_detectors.end(), 0);
+
+        return computeAUC(sumContributions(contributions, all_detectors, samples.size()), classes);
+    }
+
+    // Drop the detectors of a calibrated model that separate anomalous from normal test samples the least, keeping the
+    // AUC of the recalibrated responses within auc_tolerance of the full model's, and get the kept detectors. Removing
+    // detectors changes the pairings of the others, so candidates from the contributions alone are validated by simulating
+    // the pruned model, searching for the most detectors that can be dropped in their order
+    std::vector<uint16_t> pruneModel(Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint32_t const& monitoring_rounds, uint16_t const& n_features, const std::vector<std::vector<float>>& samples, const std::vector<int16_t>& classes, const std::vector<uint16_t>& equivalent_samples, const std::vector<uint16_t>& normal_multiplicity, uint16_t const& activation_threshold_percent, uint16_t const& activation_tau, SignatureIndex const& signature_index, double const& auc_tolerance, PruningReport& report, uint16_t const& n_threads = 1)
+    {
+        uint16_t const n_detectors = agents.id.size() - n_presenters;
+
+        const std::vector<std::vector<uint32_t>> number_pairings = getSamplesNumberPairings(agents, workspace, n_presenters, monitoring_rounds, n_features, samples, equivalent_samples, activation_tau, signature_index, n_threads);
+        const std::vector<std::vector<uint32_t>> contributions = getDetectorsContributions(agents, n_presenters, number_pairings);
+
+        std::vector<uint16_t> all_detectors(n_detectors);
+        std::iota(all_detectors.begin(), all_detectors.end(), 0);
+
+        report.n_detectors = n_detectors;
+        report.auc = computeAUC(sumContributions(contributions, all_detectors, samples.size()), classes);
+        report.pruned_auc = report.auc;
+
+        double const min_auc = report.auc - auc_tolerance;
+        const std::vector<uint16_t> dropped = rankDroppedDetectors(contributions, classes, min_auc);
+
+        // Binary search of the number of dropped detectors, assuming fewer drops never lower the AUC
+        uint16_t low = 0;
+        uint16_t high = dropped.size();
+        while (low < high) {
+            uint16_t const n_dropped = low + (high - low + 1) / 2;
+            double const auc = evaluatePrunedModel(agents, workspace, n_presenters, monitoring_rounds, n_features, samples, classes, equivalent_samples, normal_multiplicity, activation_threshold_percent, getKeptDetectors(n_detectors, dropped, n_dropped), n_threads);
+            ++report.n_evaluated;
+
+            if (auc >= min_auc) {
+                low = n_dropped;
+                report.pruned_auc = auc;
+            } else {
+                high = n_dropped - 1;
+            }
+        }
+
+        const std::vector<uint16_t> detectors_kept = getKeptDetectors(n_detectors, dropped, low);
+        report.n_kept = detectors_kept.size();
+
+        pruneDetectors(agents, n_presenters, detectors_kept);
+        resizeWorkspaceAgents(workspace, agents.id.size());
+
+        return detectors_kept;
+    }
+
+} // namespace cfm
+
+#endif // PRUNE_H
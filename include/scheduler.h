@@ -0,0 +1,239 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "utils.h"
+#include <atomic>               // atomic, atomic_thread_fence
+#include <condition_variable>   // condition_variable
+#include <mutex>                // mutex, unique_lock, lock_guard
+#include <thread>               // thread, yield
+
+namespace cfm
+{
+
+    // Outcome of a steal attempt
+    enum StealResult
+    {
+        STEAL_SUCCESS,
+        STEAL_EMPTY,
+        STEAL_ABORT
+    };
+
+    // Chase-Lev work-stealing deque over a fixed set of task indices
+    struct TaskDeque
+    {
+        // Tasks are filled before the workers start and never pushed afterwards
+        std::vector<uint32_t> tasks;
+
+        // Next task thieves take
+        std::atomic<int64_t> top;
+
+        // One past the next task the owner takes
+        std::atomic<int64_t> bottom;
+
+        TaskDeque() : top(0), bottom(0) {}
+    };
+
+    // Take the owner's most recent task, return false if the deque is empty
+    bool popTask(TaskDeque& deque, uint32_t& task)
+    {
+        int64_t const b = deque.bottom.load(std::memory_order_relaxed) - 1;
+        deque.bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = deque.top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            deque.bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        task = deque.tasks[b];
+        if (t == b) {
+            // Last task, race thieves for it
+            bool const won = deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            deque.bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+
+        return true;
+    }
+
+    // Take the oldest task of another worker's deque
+    StealResult stealTask(TaskDeque& deque, uint32_t& task)
+    {
+        int64_t t = deque.top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t const b = deque.bottom.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return STEAL_EMPTY;
+        }
+
+        task = deque.tasks[t];
+        if (!deque.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return STEAL_ABORT;
+        }
+
+        return STEAL_SUCCESS;
+    }
+
+    // Run task(worker, index) for every index below n_tasks on n_workers threads that steal from each other
+    template<class Task>
+    void runWorkStealing(uint16_t const& n_workers, uint32_t const& n_tasks, Task task)
+    {
+        // A single worker runs every task in order on the calling thread
+        if (n_workers <= 1) {
+            for (uint32_t i = 0; i < n_tasks; ++i) {
+                task(0, i);
+            }
+            return;
+        }
+
+        // Deal contiguous blocks of tasks, owners take them from the front of their block
+        std::vector<TaskDeque> deques(n_workers);
+        for (uint16_t worker = 0; worker < n_workers; ++worker) {
+            uint32_t const first = (uint64_t)n_tasks * worker / n_workers;
+            uint32_t const last = (uint64_t)n_tasks * (worker + 1) / n_workers;
+            for (uint32_t i = last; i > first; --i) {
+                deques.at(worker).tasks.push_back(i - 1);
+            }
+            deques.at(worker).bottom.store(deques.at(worker).tasks.size(), std::memory_order_relaxed);
+        }
+
+        auto run = [&](uint16_t const worker) {
+            uint32_t index;
+            while (true) {
+                if (popTask(deques[worker], index)) {
+                    task(worker, index);
+                    continue;
+                }
+
+                // No task is ever added, so the work is done once every deque is seen empty
+                bool busy = false;
+                bool stolen = false;
+                for (uint16_t offset = 1; offset < n_workers && !stolen; ++offset) {
+                    StealResult const result = stealTask(deques[(worker + offset) % n_workers], index);
+                    busy |= result == STEAL_ABORT;
+                    stolen = result == STEAL_SUCCESS;
+                }
+
+                if (stolen) {
+                    task(worker, index);
+                } else if (!busy) {
+                    break;
+                }
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (uint16_t worker = 1; worker < n_workers; ++worker) {
+            threads.emplace_back(run, worker);
+        }
+        run(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Threads kept alive across the many short jobs of interaction rounds, the calling thread is worker 0
+    struct RoundWorkers
+    {
+        uint16_t n_workers = 1;
+        std::vector<std::thread> threads;
+
+        // Current job
+        void (*job)(void*, uint16_t) = nullptr;
+        void* context = nullptr;
+
+        // Incremented for every job, workers run each generation once
+        std::atomic<uint64_t> generation{0};
+
+        // Workers still running the current job
+        std::atomic<uint16_t> remaining{0};
+
+        std::atomic<bool> stopping{false};
+
+        // Idle workers stop spinning and sleep here
+        std::mutex mutex;
+        std::condition_variable wake;
+    };
+
+    // Spins of an idle worker before it sleeps
+    uint32_t const ROUND_WORKER_SPINS = 1 << 12;
+
+    // Run jobs until the workers are stopped
+    void runRoundWorker(RoundWorkers& workers, uint16_t const worker)
+    {
+        uint64_t seen = 0;
+        while (true) {
+            // Jobs come in quick succession during a round, so spin before sleeping
+            uint32_t spins = 0;
+            while (workers.generation.load(std::memory_order_acquire) == seen && spins++ < ROUND_WORKER_SPINS) {
+                std::this_thread::yield();
+            }
+            if (workers.generation.load(std::memory_order_acquire) == seen) {
+                std::unique_lock<std::mutex> lock(workers.mutex);
+                workers.wake.wait(lock, [&]{ return workers.generation.load(std::memory_order_acquire) != seen; });
+            }
+            seen = workers.generation.load(std::memory_order_acquire);
+
+            if (workers.stopping.load(std::memory_order_acquire)) {
+                break;
+            }
+
+            workers.job(workers.context, worker);
+            workers.remaining.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    // Start n_workers - 1 threads, nothing is started for a single worker
+    void startRoundWorkers(RoundWorkers& workers, uint16_t const& n_workers)
+    {
+        workers.n_workers = std::max<uint16_t>(n_workers, 1);
+        for (uint16_t worker = 1; worker < workers.n_workers; ++worker) {
+            workers.threads.emplace_back(runRoundWorker, std::ref(workers), worker);
+        }
+    }
+
+    // Publish a new generation and wake sleeping workers
+    void advanceRoundWorkers(RoundWorkers& workers)
+    {
+        {
+            std::lock_guard<std::mutex> lock(workers.mutex);
+            workers.generation.fetch_add(1, std::memory_order_acq_rel);
+        }
+        workers.wake.notify_all();
+    }
+
+    // Stop and join the workers' threads
+    void stopRoundWorkers(RoundWorkers& workers)
+    {
+        if (workers.threads.empty()) {
+            return;
+        }
+
+        workers.stopping.store(true, std::memory_order_release);
+        advanceRoundWorkers(workers);
+        for (auto& thread : workers.threads) {
+            thread.join();
+        }
+        workers.threads.clear();
+        workers.stopping.store(false, std::memory_order_release);
+    }
+
+    // Run job(context, worker) on every worker and wait for all of them
+    void runRoundJob(RoundWorkers& workers, void (*job)(void*, uint16_t), void* context)
+    {
+        workers.job = job;
+        workers.context = context;
+        workers.remaining.store(workers.n_workers - 1, std::memory_order_release);
+        advanceRoundWorkers(workers);
+
+        job(context, 0);
+        while (workers.remaining.load(std::memory_order_acquire) != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+} // namespace cfm
+
+#endif // SCHEDULER_H
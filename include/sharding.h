@@ -0,0 +1,286 @@
+#ifndef SHARDING_H
+#define SHARDING_H
+
+#include "monitoring.h"
+#include <fcntl.h>      // O_CREAT, O_RDWR
+#include <sys/mman.h>   // shm_open, shm_unlink, mmap, munmap
+#include <sys/wait.h>   // waitpid, WIFEXITED, WEXITSTATUS
+#include <unistd.h>     // fork, ftruncate, close, getpid, _exit
+
+namespace cfm
+{
+
+    // Trained model, test samples and responses shared between the coordinator and its workers
+    struct SharedScoringRegion
+    {
+        // Mapped memory
+        void* memory = nullptr;
+        std::size_t size = 0;
+
+        // Model shape
+        uint32_t n_presenters = 0;
+        uint32_t n_detectors = 0;
+        uint32_t n_features = 0;
+        uint32_t n_samples = 0;
+        uint32_t n_shards = 0;
+        uint16_t activation_tau = 0;
+        uint32_t monitoring_rounds = 0;
+        uint16_t tau_cap = 0;
+        bool fast_shuffle = false;
+
+        // Detectors' subtypes, global lists, critical values and activation thresholds (row-major)
+        uint16_t* subtypes = nullptr;
+        uint16_t* global_lists = nullptr;
+        float* left_criticals = nullptr;
+        float* right_criticals = nullptr;
+        uint32_t* activation_thresholds = nullptr;
+
+        // Samples to score (row-major) and the shard each one belongs to
+        float* samples = nullptr;
+        uint32_t* shard_offsets = nullptr;
+
+        // Responses written by the workers, completed shards and samples scored by each shard's attempts
+        uint32_t* responses = nullptr;
+        uint32_t* shards_done = nullptr;
+        uint32_t* shards_progress = nullptr;
+    };
+
+    // Round a byte offset up to an 8-byte boundary
+    std::size_t alignSharedOffset(std::size_t const& offset)
+    {
+        return (offset + 7) & ~static_cast<std::size_t>(7);
+    }
+
+    // Place the trained model and the samples to score in POSIX shared memory
+    SharedScoringRegion createSharedScoringRegion(Agents const& agents, uint16_t const& n_presenters, uint16_t const& n_features, uint16_t const& activation_tau, uint32_t const& monitoring_rounds, bool const& fast_shuffle, const std::vector<std::vector<float>>& test_set, const std::vector<uint16_t>& sample_ids, uint32_t const& n_shards)
+    {
+        SharedScoringRegion region;
+        region.n_presenters = n_presenters;
+        region.n_detectors = agents.id.size() - n_presenters;
+        region.n_features = n_features;
+        region.n_samples = sample_ids.size();
+        region.n_shards = n_shards;
+        region.activation_tau = activation_tau;
+        region.monitoring_rounds = monitoring_rounds;
+        region.tau_cap = agents.tau_cap;
+        region.fast_shuffle = fast_shuffle;
+
+        // Byte offsets of every array
+        std::size_t const list_length = 2 * n_presenters;
+        std::size_t offsets[10];
+        std::size_t size = 0;
+        std::size_t const sizes[10] = {
+            region.n_detectors * sizeof(uint16_t),
+            region.n_detectors * list_length * sizeof(uint16_t),
+            region.n_detectors * n_features * sizeof(float),
+            region.n_detectors * n_features * sizeof(float),
+            region.n_detectors * sizeof(uint32_t),
+            region.n_samples * n_features * sizeof(float),
+            (n_shards + 1) * sizeof(uint32_t),
+            region.n_samples * sizeof(uint32_t),
+            n_shards * sizeof(uint32_t),
+            n_shards * sizeof(uint32_t)
+        };
+        for (uint16_t i = 0; i < 10; ++i) {
+            offsets[i] = size;
+            size = alignSharedOffset(size + sizes[i]);
+        }
+        region.size = size > 0 ? size : 1;
+
+        // Workers inherit the mapping, so the name is unlinked as soon as it is mapped
+        std::string const name = "/cfm-scoring-" + std::to_string(getpid());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd == -1) {
+            std::cout << "Error creating shared memory" << '\n';
+            std::exit(EXIT_FAILURE);
+        }
+        if (ftruncate(fd, region.size) == -1) {
+            std::cout << "Error sizing shared memory" << '\n';
+            std::exit(EXIT_FAILURE);
+        }
+        region.memory = mmap(nullptr, region.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        shm_unlink(name.c_str());
+        if (region.memory == MAP_FAILED) {
+            std::cout << "Error mapping shared memory" << '\n';
+            std::exit(EXIT_FAILURE);
+        }
+
+        char* base = static_cast<char*>(region.memory);
+        region.subtypes = reinterpret_cast<uint16_t*>(base + offsets[0]);
+        region.global_lists = reinterpret_cast<uint16_t*>(base + offsets[1]);
+        region.left_criticals = reinterpret_cast<float*>(base + offsets[2]);
+        region.right_criticals = reinterpret_cast<float*>(base + offsets[3]);
+        region.activation_thresholds = reinterpret_cast<uint32_t*>(base + offsets[4]);
+        region.samples = reinterpret_cast<float*>(base + offsets[5]);
+        region.shard_offsets = reinterpret_cast<uint32_t*>(base + offsets[6]);
+        region.responses = reinterpret_cast<uint32_t*>(base + offsets[7]);
+        region.shards_done = reinterpret_cast<uint32_t*>(base + offsets[8]);
+        region.shards_progress = reinterpret_cast<uint32_t*>(base + offsets[9]);
+
+        // Copy the trained model
+        for (uint32_t i = 0; i < region.n_detectors; ++i) {
+            uint16_t const id = n_presenters + i;
+            region.subtypes[i] = agents.subtype.at(id);
+            std::copy(agents.global_list.at(id).begin(), agents.global_list.at(id).end(), region.global_lists + i * list_length);
+            std::copy(agents.left_criticals.at(id).begin(), agents.left_criticals.at(id).end(), region.left_criticals + i * n_features);
+            std::copy(agents.right_criticals.at(id).begin(), agents.right_criticals.at(id).end(), region.right_criticals + i * n_features);
+            region.activation_thresholds[i] = agents.activation_thresholds.at(id);
+        }
+
+        // Copy the samples to score
+        for (uint32_t i = 0; i < region.n_samples; ++i) {
+            std::copy(test_set.at(sample_ids.at(i)).begin(), test_set.at(sample_ids.at(i)).end(), region.samples + i * n_features);
+        }
+
+        // Split samples into contiguous shards of nearly equal size
+        for (uint32_t shard = 0; shard <= n_shards; ++shard) {
+            region.shard_offsets[shard] = (uint64_t)region.n_samples * shard / n_shards;
+        }
+
+        return region;
+    }
+
+    // Release the shared memory
+    void destroySharedScoringRegion(SharedScoringRegion& region)
+    {
+        munmap(region.memory, region.size);
+        region.memory = nullptr;
+    }
+
+    // Rebuild the trained model from shared memory
+    Agents loadSharedModel(SharedScoringRegion const& region)
+    {
+        uint16_t const n_presenters = region.n_presenters;
+        std::size_t const list_length = 2 * n_presenters;
+
+        Agents agents = initAgents(n_presenters, region.n_detectors);
+
+        std::vector<std::vector<uint16_t>> global_lists(region.n_detectors);
+        std::vector<std::vector<float>> left_criticals(region.n_detectors);
+        std::vector<std::vector<float>> right_criticals(region.n_detectors);
+        for (uint32_t i = 0; i < region.n_detectors; ++i) {
+            global_lists.at(i).assign(region.global_lists + i * list_length, region.global_lists + (i + 1) * list_length);
+            left_criticals.at(i).assign(region.left_criticals + i * region.n_features, region.left_criticals + (i + 1) * region.n_features);
+            right_criticals.at(i).assign(region.right_criticals + i * region.n_features, region.right_criticals + (i + 1) * region.n_features);
+            agents.activation_thresholds.at(n_presenters + i) = region.activation_thresholds[i];
+
+            // Pruned models keep their detectors' subtypes
+            agents.subtype.at(n_presenters + i) = region.subtypes[i];
+            agents.signal.at(n_presenters + i) = region.subtypes[i];
+        }
+        initDetectorsGlobalLists(agents, n_presenters, global_lists);
+        initDetectorsCriticalLists(agents, n_presenters, left_criticals, right_criticals);
+        agents.tau_cap = region.tau_cap;
+
+        return agents;
+    }
+
+    // Score one shard of samples into shared memory
+    void scoreShard(SharedScoringRegion& region, uint32_t const& shard)
+    {
+        Agents agents = loadSharedModel(region);
+        uint16_t const n_presenters = region.n_presenters;
+        uint16_t const n_features = region.n_features;
+        Workspace workspace = initWorkspace(agents.id.size(), n_presenters, n_features);
+        workspace.fast_shuffle = region.fast_shuffle;
+        const SignatureIndex signature_index = buildSignatureIndex(agents, n_presenters, n_features);
+
+        std::vector<float> sample(n_features);
+        for (uint32_t i = region.shard_offsets[shard]; i < region.shard_offsets[shard + 1]; ++i) {
+            std::copy(region.samples + i * n_features, region.samples + (i + 1) * n_features, sample.begin());
+            region.responses[i] = scoreSample(agents, workspace, n_presenters, region.monitoring_rounds, n_features, sample, region.activation_tau, &signature_index);
+            ++region.shards_progress[shard];
+        }
+
+        region.shards_done[shard] = 1;
+    }
+
+    // Score samples with worker processes, re-dispatching the shards of failed workers, and count the scored samples in
+    // the metrics as workers finish
+    std::vector<uint32_t> scoreSamplesSharded(Agents const& agents, uint16_t const& n_presenters, uint16_t const& n_features, uint16_t const& activation_tau, uint32_t const& monitoring_rounds, bool const& fast_shuffle, const std::vector<std::vector<float>>& test_set, const std::vector<uint16_t>& sample_ids, LiveMetrics* metrics, uint16_t const& n_processes, uint16_t const& max_attempts = 3)
+    {
+        // Shards are smaller than one process' share so a failure loses little work
+        uint32_t const n_shards = std::max<uint32_t>(1, std::min<uint32_t>(sample_ids.size(), 4 * n_processes));
+        SharedScoringRegion region = createSharedScoringRegion(agents, n_presenters, n_features, activation_tau, monitoring_rounds, fast_shuffle, test_set, sample_ids, n_shards);
+
+        // Flush buffered output so workers don't inherit it
+        std::cout.flush();
+
+        std::vector<uint32_t> pending_shards(n_shards);
+        std::iota(pending_shards.rbegin(), pending_shards.rend(), 0);
+        std::vector<uint16_t> attempts(n_shards);
+        std::map<pid_t, uint32_t> running_shards;
+
+        // Samples already counted in the metrics
+        uint64_t samples_reported = 0;
+        auto reportProgress = [&]() {
+            uint64_t const samples_scored = std::accumulate(region.shards_progress, region.shards_progress + n_shards, (uint64_t)0);
+            addMetricsSamples(metrics, samples_scored - samples_reported, (samples_scored - samples_reported) * monitoring_rounds);
+            samples_reported = samples_scored;
+        };
+
+        while (!pending_shards.empty() || !running_shards.empty()) {
+            // Launch workers up to the process limit
+            while (!pending_shards.empty() && running_shards.size() < n_processes) {
+                uint32_t const shard = pending_shards.back();
+                pending_shards.pop_back();
+                ++attempts.at(shard);
+
+                // Fork-safety: other threads (metrics reporter, trace writer) may hold locks at fork time, so a worker only
+                // touches the shared region and the model it rebuilds from it, never reports or writes files, and leaves
+                // with _exit so no destructors or exit handlers run
+                pid_t pid = fork();
+                if (pid == 0) {
+                    scoreShard(region, shard);
+                    _exit(EXIT_SUCCESS);
+                }
+                if (pid == -1) {
+                    // Score in the coordinator if no process can be created
+                    scoreShard(region, shard);
+                    reportProgress();
+                    continue;
+                }
+                running_shards[pid] = shard;
+            }
+
+            if (running_shards.empty()) {
+                continue;
+            }
+
+            // Collect a finished worker
+            int status = 0;
+            pid_t pid = waitpid(-1, &status, 0);
+            auto found = running_shards.find(pid);
+            if (found == running_shards.end()) {
+                continue;
+            }
+            uint32_t const shard = found->second;
+            running_shards.erase(found);
+
+            // The worker's writes are visible once it has been reaped
+            reportProgress();
+
+            // Re-dispatch the shard of a failed worker
+            bool const succeeded = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS && region.shards_done[shard] == 1;
+            if (!succeeded) {
+                std::cout << "Scoring worker for shard " << shard << " failed" << '\n';
+                if (attempts.at(shard) < max_attempts) {
+                    pending_shards.push_back(shard);
+                } else {
+                    scoreShard(region, shard);
+                    reportProgress();
+                }
+            }
+        }
+
+        // Gather responses in sample order
+        std::vector<uint32_t> responses(region.responses, region.responses + region.n_samples);
+        destroySharedScoringRegion(region);
+
+        return responses;
+    }
+
+} // namespace cfm
+
+#endif // SHARDING_H
@@ -0,0 +1,132 @@
+#ifndef SIGNATURES_H
+#define SIGNATURES_H
+
+#include "cfmodel.h"
+
+namespace cfm
+{
+
+    // Sorted critical values of each feature over all detectors
+    struct SignatureIndex
+    {
+        // Distinct critical values of each feature in ascending order
+        std::vector<std::vector<float>> breakpoints;
+
+        // Signature codes of each detector's left critical values
+        std::vector<std::vector<uint32_t>> left_codes;
+
+        // Signature codes of each detector's right critical values
+        std::vector<std::vector<uint32_t>> right_codes;
+    };
+
+    // Code of a value's position among a feature's breakpoints (even = between breakpoints, odd = on a breakpoint)
+    uint32_t computeBreakpointCode(const std::vector<float>& breakpoints, float const& value)
+    {
+        auto it = std::lower_bound(breakpoints.begin(), breakpoints.end(), value);
+        uint32_t code = 2 * (it - breakpoints.begin());
+        if (it != breakpoints.end() && *it == value) {
+            ++code;
+        }
+
+        return code;
+    }
+
+    // Build the breakpoint index from the detectors' critical values
+    SignatureIndex buildSignatureIndex(Agents const& agents, uint16_t const& n_presenters, uint16_t const& n_features)
+    {
+        SignatureIndex index;
+        index.breakpoints.resize(n_features);
+
+        // Collect every critical value of each feature
+        for (uint16_t i = n_presenters; i < agents.id.size(); ++i) {
+            for (uint16_t feature = 0; feature < n_features; ++feature) {
+                index.breakpoints.at(feature).push_back(agents.left_criticals.at(i).at(feature));
+                index.breakpoints.at(feature).push_back(agents.right_criticals.at(i).at(feature));
+            }
+        }
+
+        for (auto& row : index.breakpoints) {
+            std::sort(row.begin(), row.end());
+            row.erase(std::unique(row.begin(), row.end()), row.end());
+        }
+
+        // Translate each detector's critical values into codes
+        uint16_t const n_detectors = agents.id.size() - n_presenters;
+        index.left_codes.resize(n_detectors, std::vector<uint32_t>(n_features));
+        index.right_codes.resize(n_detectors, std::vector<uint32_t>(n_features));
+        for (uint16_t i = 0; i < n_detectors; ++i) {
+            for (uint16_t feature = 0; feature < n_features; ++feature) {
+                index.left_codes.at(i).at(feature) = computeBreakpointCode(index.breakpoints.at(feature), agents.left_criticals.at(n_presenters + i).at(feature));
+                index.right_codes.at(i).at(feature) = computeBreakpointCode(index.breakpoints.at(feature), agents.right_criticals.at(n_presenters + i).at(feature));
+            }
+        }
+
+        return index;
+    }
+
+    // Map a sample to its signature, samples with the same signature produce the same local lists
+    void computeSampleSignature(SignatureIndex const& index, const std::vector<float>& sample, std::vector<uint32_t>& signature)
+    {
+        signature.resize(index.breakpoints.size());
+        for (uint16_t feature = 0; feature < signature.size(); ++feature) {
+            signature.at(feature) = computeBreakpointCode(index.breakpoints.at(feature), sample.at(feature));
+        }
+    }
+
+    // Map a sample to a new signature
+    std::vector<uint32_t> computeSampleSignature(SignatureIndex const& index, const std::vector<float>& sample)
+    {
+        std::vector<uint32_t> signature;
+        computeSampleSignature(index, sample, signature);
+
+        return signature;
+    }
+
+    // Return true if a signature code lies strictly inside a detector's critical interval of a feature
+    bool getSignatureNormality(SignatureIndex const& index, uint16_t const& detector_index, uint16_t const& feature, uint32_t const& code)
+    {
+        return index.left_codes.at(detector_index).at(feature) < code && code < index.right_codes.at(detector_index).at(feature);
+    }
+
+    // Build detectors' local lists directly from a sample's signature
+    void mapSignatureToDetectorsLocalLists(Agents& agents, SignatureIndex const& index, uint16_t const& n_presenters, uint16_t const& n_features, const std::vector<uint32_t>& signature, std::vector<uint16_t>& signal_out)
+    {
+        signal_out.resize(n_features);
+
+        // Loop through detectors
+        for (uint16_t i = n_presenters; i < agents.id.size(); ++i) {
+            agents.local_list.at(i).assign(getLocalListWords(n_presenters), 0);
+
+            // Normality of each feature is shared by all presenter sets
+            for (uint16_t feature = 0; feature < n_features; ++feature) {
+                signal_out.at(feature) = !getSignatureNormality(index, i - n_presenters, feature, signature.at(feature));
+            }
+
+            // Loop through presenters
+            uint16_t feature = 0;
+            for (uint16_t j = 0; j < n_presenters; ++j) {
+                // Reset feature counter at the end of every presenter set
+                if (feature == n_features) {
+                    feature = 0;
+                }
+                agents.local_list.at(i).at(j >> 6) |= (uint64_t)signal_out.at(feature++) << (j & 63);
+            }
+        }
+    }
+
+    // Find the first test sample with the same signature as each test sample
+    std::vector<uint16_t> findEquivalentSamples(SignatureIndex const& index, const std::vector<std::vector<float>>& samples)
+    {
+        std::map<std::vector<uint32_t>, uint16_t> first_samples;
+        std::vector<uint16_t> equivalent_samples(samples.size());
+
+        for (uint16_t i = 0; i < samples.size(); ++i) {
+            equivalent_samples.at(i) = first_samples.emplace(computeSampleSignature(index, samples.at(i)), i).first->second;
+        }
+
+        return equivalent_samples;
+    }
+
+} // namespace cfm
+
+#endif // SIGNATURES_H
@@ -0,0 +1,99 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include "utils.h"
+#include <cmath>    // log, pow, ceil, round
+
+namespace cfm
+{
+
+    // Relative error of the values returned by a quantile sketch
+    double const SKETCH_RELATIVE_ACCURACY = 0.01;
+
+    // Buckets kept by a quantile sketch before its lowest ones are collapsed
+    uint16_t const SKETCH_MAX_BUCKETS = 512;
+
+    // Mergeable quantile sketch of non-negative counts with logarithmic buckets (DDSketch), the lowest buckets are
+    // collapsed beyond its bound, so memory stays bounded and upper quantiles keep their relative accuracy
+    struct QuantileSketch
+    {
+        // Ratio between consecutive bucket bounds
+        double gamma = (1 + SKETCH_RELATIVE_ACCURACY) / (1 - SKETCH_RELATIVE_ACCURACY);
+        double log_gamma = std::log(gamma);
+
+        uint16_t max_buckets = SKETCH_MAX_BUCKETS;
+
+        // Weight of each bucket, bucket i holds the values in (gamma^(i-1), gamma^i]
+        std::map<int32_t, double> buckets;
+
+        // Weight of zero counts
+        double zero_weight = 0;
+
+        // Weight of all inserted values
+        double total_weight = 0;
+    };
+
+    // Collapse the lowest buckets into the next one until the sketch is within its bound
+    void collapseQuantileSketch(QuantileSketch& sketch)
+    {
+        while (sketch.buckets.size() > sketch.max_buckets) {
+            auto lowest = sketch.buckets.begin();
+            std::next(lowest)->second += lowest->second;
+            sketch.buckets.erase(lowest);
+        }
+    }
+
+    // Insert a count with a weight
+    void insertQuantileSketch(QuantileSketch& sketch, uint32_t const& value, double const& weight = 1)
+    {
+        if (value == 0) {
+            sketch.zero_weight += weight;
+        } else {
+            sketch.buckets[(int32_t)std::ceil(std::log((double)value) / sketch.log_gamma)] += weight;
+            collapseQuantileSketch(sketch);
+        }
+        sketch.total_weight += weight;
+    }
+
+    // Add another sketch with the same accuracy, its weights multiplied by scale
+    void mergeQuantileSketch(QuantileSketch& into, QuantileSketch const& from, double const& scale = 1)
+    {
+        for (auto const& kv : from.buckets) {
+            into.buckets[kv.first] += scale * kv.second;
+        }
+        into.zero_weight += scale * from.zero_weight;
+        into.total_weight += scale * from.total_weight;
+        collapseQuantileSketch(into);
+    }
+
+    // Multiply every weight, used to renormalize decayed weights
+    void scaleQuantileSketch(QuantileSketch& sketch, double const& scale)
+    {
+        for (auto& kv : sketch.buckets) {
+            kv.second *= scale;
+        }
+        sketch.zero_weight *= scale;
+        sketch.total_weight *= scale;
+    }
+
+    // Count at the same rank as computeActivationThresholds, counting from the highest value, where unit_weight is the
+    // weight of a single recent value
+    uint32_t getSketchUpperQuantile(QuantileSketch const& sketch, uint16_t const& percent, double const& unit_weight = 1)
+    {
+        double const rank = (sketch.total_weight / unit_weight - 1) * percent / 100;
+
+        double accumulated = 0;
+        for (auto it = sketch.buckets.rbegin(); it != sketch.buckets.rend(); ++it) {
+            accumulated += it->second / unit_weight;
+            if (accumulated > rank) {
+                // Bucket's value with the lowest relative error
+                return std::round(2 * std::pow(sketch.gamma, it->first) / (sketch.gamma + 1));
+            }
+        }
+
+        return 0;
+    }
+
+} // namespace cfm
+
+#endif // SKETCH_H
@@ -0,0 +1,128 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "utils.h"
+#include <atomic>   // atomic
+#include <mutex>    // mutex, lock_guard
+#include <thread>   // yield
+
+namespace cfm
+{
+
+    // Readers that can hold a snapshot at the same time, further readers wait for a free slot
+    uint16_t const SNAPSHOT_READER_SLOTS = 64;
+
+    // Immutable versions of a value published RCU-style: readers pin the current version without locks through hazard
+    // slots, and publishers retire replaced versions until no reader holds them anymore
+    template<class T>
+    struct SnapshotCell
+    {
+        std::atomic<T const*> current;
+
+        // Version each reader slot protects (null = free slot)
+        std::atomic<T const*> hazards[SNAPSHOT_READER_SLOTS];
+
+        // Replaced versions not reclaimed yet, only touched by publishers
+        std::vector<T const*> retired;
+        std::mutex publish_mutex;
+
+        SnapshotCell() : current(nullptr)
+        {
+            for (auto& hazard : hazards) {
+                hazard.store(nullptr);
+            }
+        }
+
+        ~SnapshotCell()
+        {
+            delete current.load();
+            for (auto const& snapshot : retired) {
+                delete snapshot;
+            }
+        }
+    };
+
+    // Marks a reserved reader slot that protects no version yet
+    template<class T>
+    T const* getReservedSnapshot()
+    {
+        static char reserved;
+        return reinterpret_cast<T const*>(&reserved);
+    }
+
+    // Reserve a reader slot, waiting only if every slot is taken
+    template<class T>
+    uint16_t reserveSnapshotSlot(SnapshotCell<T>& cell)
+    {
+        while (true) {
+            for (uint16_t slot = 0; slot < SNAPSHOT_READER_SLOTS; ++slot) {
+                T const* expected = nullptr;
+                if (cell.hazards[slot].load(std::memory_order_relaxed) == nullptr
+                    && cell.hazards[slot].compare_exchange_strong(expected, getReservedSnapshot<T>())) {
+                    return slot;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    // Free a reader slot, releasing the version it holds
+    template<class T>
+    void releaseSnapshotSlot(SnapshotCell<T>& cell, uint16_t const& slot)
+    {
+        cell.hazards[slot].store(nullptr, std::memory_order_release);
+    }
+
+    // Pin the current version in a reserved slot, releasing the one it held; the version stays valid until the next pin or release
+    template<class T>
+    T const* pinSnapshot(SnapshotCell<T>& cell, uint16_t const& slot)
+    {
+        T const* snapshot = cell.current.load();
+        while (true) {
+            cell.hazards[slot].store(snapshot);
+
+            // A version still current after being protected cannot have been retired before
+            T const* const latest = cell.current.load();
+            if (latest == snapshot) {
+                return snapshot;
+            }
+            snapshot = latest;
+        }
+    }
+
+    // Delete retired versions no reader holds anymore
+    template<class T>
+    void reclaimSnapshots(SnapshotCell<T>& cell)
+    {
+        std::size_t n_kept = 0;
+        for (auto const& snapshot : cell.retired) {
+            bool held = false;
+            for (auto const& hazard : cell.hazards) {
+                held |= hazard.load() == snapshot;
+            }
+
+            if (held) {
+                cell.retired[n_kept++] = snapshot;
+            } else {
+                delete snapshot;
+            }
+        }
+        cell.retired.resize(n_kept);
+    }
+
+    // Publish a new version taking ownership of it, readers pinning from now on get it while readers of older versions finish undisturbed
+    template<class T>
+    void publishSnapshot(SnapshotCell<T>& cell, T const* snapshot)
+    {
+        std::lock_guard<std::mutex> lock(cell.publish_mutex);
+
+        T const* const replaced = cell.current.exchange(snapshot);
+        if (replaced != nullptr) {
+            cell.retired.push_back(replaced);
+        }
+        reclaimSnapshots(cell);
+    }
+
+} // namespace cfm
+
+#endif // SNAPSHOT_H
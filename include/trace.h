@@ -0,0 +1,206 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "cfmodel.h"
+#include <condition_variable>   // condition_variable
+#include <cstdio>               // FILE, fopen, fwrite, fclose
+#include <mutex>                // mutex, unique_lock, lock_guard
+#include <thread>               // thread
+
+namespace cfm
+{
+
+    // Trace file layout: "CFMT", format version, flags, then a sequence of records
+    uint8_t const TRACE_VERSION = 1;
+    uint8_t const TRACE_FLAG_COMPRESSED = 1;
+
+    // Trace record types
+    enum TraceRecord : uint8_t
+    {
+        TRACE_TAUS_MAP = 1,     // phase, agent, number of entries, (tau, count) entries
+        TRACE_ROUND = 2         // phase, round, pairs, dissociations, educations
+    };
+
+    // Simulation phases recorded in traces
+    enum TracePhase : uint8_t
+    {
+        TRACE_UNTRAINED = 0,
+        TRACE_TRAINING = 1,
+        TRACE_TRAINED = 2
+    };
+
+    // Binary trace writer flushing records from a background thread
+    struct TraceWriter
+    {
+        FILE* file = nullptr;
+
+        // Varint encoding with delta-encoded taus
+        bool compressed = false;
+
+        // Record a summary of every round
+        bool record_rounds = false;
+
+        // Phase of the records being written
+        uint8_t phase = TRACE_UNTRAINED;
+
+        // Records waiting to be written and the buffer being written
+        std::vector<char> pending;
+        std::vector<char> writing;
+
+        std::mutex mutex;
+        std::condition_variable ready;
+        bool closing = false;
+        std::thread thread;
+    };
+
+    // Size of pending records that wakes the writer thread
+    std::size_t const TRACE_FLUSH_BYTES = 1 << 16;
+
+    // Write buffers handed over by the simulation until the trace is closed
+    void runTraceWriter(TraceWriter& trace)
+    {
+        std::unique_lock<std::mutex> lock(trace.mutex);
+        while (true) {
+            trace.ready.wait(lock, [&]{ return trace.closing || trace.pending.size() >= TRACE_FLUSH_BYTES; });
+            bool const closing = trace.closing;
+            trace.writing.swap(trace.pending);
+            lock.unlock();
+
+            // Write without holding the lock so the simulation keeps appending
+            if (!trace.writing.empty()) {
+                std::fwrite(trace.writing.data(), 1, trace.writing.size(), trace.file);
+                trace.writing.clear();
+            }
+
+            lock.lock();
+            if (closing && trace.pending.empty()) {
+                break;
+            }
+        }
+    }
+
+    // Open a trace file and start its writer thread
+    void openTrace(TraceWriter& trace, std::string const& file_path, bool const& compressed, bool const& record_rounds)
+    {
+        trace.file = std::fopen(file_path.c_str(), "wb");
+
+        // Check if file opened correctly
+        if (trace.file == nullptr) {
+            std::cout << "Error opening file" << '\n';
+            std::exit(EXIT_FAILURE);
+        }
+
+        trace.compressed = compressed;
+        trace.record_rounds = record_rounds;
+        trace.pending.reserve(2 * TRACE_FLUSH_BYTES);
+        trace.writing.reserve(2 * TRACE_FLUSH_BYTES);
+
+        char const header[6] = {'C', 'F', 'M', 'T', (char)TRACE_VERSION, (char)(compressed ? TRACE_FLAG_COMPRESSED : 0)};
+        trace.pending.insert(trace.pending.end(), header, header + sizeof(header));
+
+        trace.thread = std::thread(runTraceWriter, std::ref(trace));
+    }
+
+    // Write the remaining records and close the trace file
+    void closeTrace(TraceWriter& trace)
+    {
+        if (trace.file == nullptr) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(trace.mutex);
+            trace.closing = true;
+        }
+        trace.ready.notify_one();
+        trace.thread.join();
+
+        std::fclose(trace.file);
+        trace.file = nullptr;
+    }
+
+    // Append an unsigned value to a record
+    void putTraceValue(std::vector<char>& buffer, bool const& compressed, uint64_t value)
+    {
+        // LEB128 varint
+        if (compressed) {
+            while (value >= 0x80) {
+                buffer.push_back((char)(value | 0x80));
+                value >>= 7;
+            }
+            buffer.push_back((char)value);
+            return;
+        }
+
+        // Little-endian 32-bit value
+        for (uint16_t i = 0; i < 4; ++i) {
+            buffer.push_back((char)(value >> (8 * i)));
+        }
+    }
+
+    // Hand a finished record over to the writer thread
+    void commitTraceRecord(TraceWriter& trace, const std::vector<char>& record)
+    {
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(trace.mutex);
+            trace.pending.insert(trace.pending.end(), record.begin(), record.end());
+            wake = trace.pending.size() >= TRACE_FLUSH_BYTES;
+        }
+        if (wake) {
+            trace.ready.notify_one();
+        }
+    }
+
+    // Record every agent's taus map
+    void recordTausMaps(TraceWriter& trace, Agents const& agents)
+    {
+        std::vector<char> record;
+        for (auto const& id : agents.id) {
+            record.clear();
+            record.push_back((char)TRACE_TAUS_MAP);
+            putTraceValue(record, trace.compressed, trace.phase);
+            putTraceValue(record, trace.compressed, id);
+            putTraceValue(record, trace.compressed, agents.taus_map.at(id).size());
+
+            uint64_t previous_tau = 0;
+            for (auto const& kv : agents.taus_map.at(id)) {
+                putTraceValue(record, trace.compressed, trace.compressed ? kv.first - previous_tau : kv.first);
+                putTraceValue(record, trace.compressed, kv.second);
+                previous_tau = kv.first;
+            }
+
+            commitTraceRecord(trace, record);
+        }
+    }
+
+    // Count the current pairs of agents
+    uint32_t countPairs(Agents const& agents, uint16_t const& n_presenters)
+    {
+        uint32_t pairs = 0;
+        for (uint16_t i = 0; i < n_presenters; ++i) {
+            pairs += agents.match[i] > -1;
+        }
+
+        return pairs;
+    }
+
+    // Record a round's summary
+    void recordRound(TraceWriter& trace, uint32_t const& round, uint32_t const& pairs, uint32_t const& dissociations, uint32_t const& educations)
+    {
+        // Round records are small, so the buffer is reused across rounds
+        static thread_local std::vector<char> record;
+        record.clear();
+        record.push_back((char)TRACE_ROUND);
+        putTraceValue(record, trace.compressed, trace.phase);
+        putTraceValue(record, trace.compressed, round);
+        putTraceValue(record, trace.compressed, pairs);
+        putTraceValue(record, trace.compressed, dissociations);
+        putTraceValue(record, trace.compressed, educations);
+
+        commitTraceRecord(trace, record);
+    }
+
+} // namespace cfm
+
+#endif // TRACE_H
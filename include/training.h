@@ -1,27 +1,56 @@
 #ifndef TRAINING_H
 #define TRAINING_H
 
-#include "cfmodel.h"
+#include "kernels.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "trace.h"
 
 namespace cfm
 {
 
-    // Decrease the current signal's rank in the detector's global list
-    void decreaseSignalRank(Agents& agents, uint16_t const& detector, uint16_t const& signal, uint16_t const& old_rank, uint16_t const& new_rank)
+    // Replace a detector's order keys with dense ranks preserving their order
+    void compactGlobalListRanks(Agents& agents, uint16_t const& detector, std::vector<uint16_t>& rank_order)
     {
-        // Update all the signals' ranks displaced by the educated signal
-        for (auto& rank : agents.global_list.at(detector)) {
-            if (rank > old_rank && rank <= new_rank) {
-                --rank;
-            }
+        std::vector<uint16_t>& global_list = agents.global_list.at(detector);
+
+        // Sort signals by their order keys
+        rank_order.resize(global_list.size());
+        std::iota(rank_order.begin(), rank_order.end(), 0);
+        std::sort(rank_order.begin(), rank_order.end(), [&](uint16_t const& a, uint16_t const& b) { return global_list.at(a) < global_list.at(b); });
+
+        // Position in the sorted order is the signal's rank
+        for (uint16_t rank = 0; rank < rank_order.size(); ++rank) {
+            global_list.at(rank_order.at(rank)) = rank;
+        }
+        agents.global_list_tail.at(detector) = global_list.size();
+    }
+
+    // Replace all detectors' order keys with dense ranks, required before exporting global lists
+    void compactDetectorsGlobalLists(Agents& agents, uint16_t const& n_presenters)
+    {
+        std::vector<uint16_t> rank_order;
+        for (uint16_t i = n_presenters; i < agents.id.size(); ++i) {
+            compactGlobalListRanks(agents, i, rank_order);
+        }
+    }
+
+    // Move a signal to the bottom of the detector's global list
+    void moveSignalToBottom(Agents& agents, uint16_t const& detector, uint16_t const& signal, std::vector<uint16_t>& rank_order)
+    {
+        // Every other signal keeps its relative order, so a key past the current bottom is enough. Ranks are compacted once
+        // as many keys as signals were handed out, so each sort is paid by that many moves whatever the list length, or
+        // before the keys run out
+        uint32_t const list_size = agents.global_list.at(detector).size();
+        if (agents.global_list_tail.at(detector) - list_size >= list_size || agents.global_list_tail.at(detector) > UINT16_MAX) {
+            compactGlobalListRanks(agents, detector, rank_order);
         }
 
-        // Update the educated signal's rank
-        agents.global_list.at(detector).at(signal) = new_rank;
+        agents.global_list.at(detector).at(signal) = agents.global_list_tail.at(detector)++;
     }
 
     // Educate detectors' global lists
-    void education(std::mt19937& generator, Agents& agents, uint16_t const& n_presenters, uint16_t& threshold)
+    void education(std::mt19937& generator, Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint16_t& threshold)
     {
         // Check if at least one detector was trained
         bool trained = false;
@@ -38,10 +67,11 @@ namespace cfm
             // Train detector if its tau is higher than threshold
             if (detector_tau > threshold) {
                 trained = true;
+                ++workspace.educations;
 
                 int16_t detector_partner = agents.match.at(i);
 
-                decreaseSignalRank(agents, i, agents.local_list.at(i).at(detector_partner), getSignalRank(agents, n_presenters, i, detector_partner), agents.global_list.at(i).size() - 1);
+                moveSignalToBottom(agents, i, getLocalListEntry(agents, i, detector_partner), workspace.rank_order);
 
                 // Unpair detector from presenter with signal that caused a lasting pairing
                 updateAgentMatch(agents, i, -1);
@@ -56,18 +86,13 @@ namespace cfm
     }
 
     // Cellular frustration dynamics with detector training by default
-    void training(Agents& agents, uint16_t const& n_presenters, uint32_t const& frustration_rounds, uint16_t const& sample_rounds, uint16_t const& n_samples, const std::vector<uint16_t>& samples_queue, uint16_t const& n_features, const std::vector<std::vector<float>>& data_set, uint16_t const& training_interval, bool const& training_flag = true, uint16_t const& seed = 0)
+    void training(Agents& agents, Workspace& workspace, uint16_t const& n_presenters, uint32_t const& frustration_rounds, uint16_t const& sample_rounds, uint16_t const& n_samples, const std::vector<uint16_t>& samples_queue, uint16_t const& n_features, const std::vector<std::vector<float>>& data_set, uint16_t const& training_interval, bool const& training_flag = true, uint16_t const& seed = 0, TraceWriter* trace = nullptr, bool const& pipeline_samples = false)
     {
         // Initialize random number generator
         std::mt19937 generator(seed);
 
-        // Initialize interactions queue (indices = priority; elements = interaction pairs)
-        std::vector<uint16_t> interactions_queue(n_presenters);
-        std::iota(interactions_queue.begin(), interactions_queue.end(), 0);
-
-        // Initialize interaction pairs (indices = presenters' ids; elements = detectors' ids)
-        std::vector<uint16_t> interaction_pairs(n_presenters);
-        std::iota(interaction_pairs.begin(), interaction_pairs.end(), n_presenters);
+        // Initialize interactions queue and pairs
+        resetWorkspaceInteractions(workspace, n_presenters, agents.id.size() - n_presenters);
 
         // Sample counter used to loop samples
         uint32_t sample_counter = 0;
@@ -75,37 +100,70 @@ namespace cfm
         // Initialize education threshold
         uint16_t threshold = training_interval;
 
+        // Prepare each next sample on a helper thread when there is more than one sample to show
+        bool const pipelined = pipeline_samples && frustration_rounds > sample_rounds;
+        SamplePipeline pipeline;
+        if (pipelined) {
+            openSamplePipeline(pipeline, agents, n_presenters, n_features);
+        }
+
+        uint64_t const allocations_before = getAllocationCount();
+
         // Main loop
         for (uint32_t round = 0; round < frustration_rounds; ++round) {
             // Loop through samples
             if (round % sample_rounds == 0) {
-                changeSample(agents, n_presenters, n_features, data_set.at(samples_queue.at(sample_counter++)));
+                if (pipelined && round > 0) {
+                    swapSample(pipeline, agents);
+                    ++sample_counter;
+                } else {
+                    changeSampleDispatch(agents, workspace, n_presenters, n_features, data_set.at(samples_queue.at(sample_counter++)));
+                }
 
                 // Reset sample counter
                 if (sample_counter == n_samples) {
                     sample_counter = 0;
                 }
+
+                // Prepare the next sample during this sample's rounds
+                if (pipelined && round + sample_rounds < frustration_rounds) {
+                    requestSample(pipeline, data_set.at(samples_queue.at(sample_counter)));
+                }
             }
 
             // Loop through interactions between pairs of agents
-            interactions(generator, agents, n_presenters, interactions_queue, interaction_pairs);
+            runInteractions(generator, agents, n_presenters, workspace);
 
             // Randomly dissociate agents
-            dissociation(generator, agents);
+            dissociation(generator, agents, workspace);
 
             // Update agents' metrics
             updateAgentsMetrics(agents);
 
             // Train eligible detectors
             if (training_flag && round % training_interval == 0 && round > 0) {
-                education(generator, agents, n_presenters, threshold);
+                education(generator, agents, workspace, n_presenters, threshold);
+                addMetricsEducation(workspace.metrics, workspace.educations, threshold);
+            }
+
+            // Record the round's summary
+            if (trace != nullptr && trace->record_rounds) {
+                recordRound(*trace, round, countPairs(agents, n_presenters), workspace.dissociations, workspace.educations);
             }
+            workspace.dissociations = 0;
+            workspace.educations = 0;
+
+            addMetricsRounds(workspace.metrics, 1);
         }
 
+        closeSamplePipeline(pipeline);
+
         // Register taus on last round
         for (auto const& id : agents.id) {
-            ++agents.taus_map.at(id)[agents.tau.at(id)];
+            registerAgentTau(agents, id);
         }
+
+        registerHotPathAllocations(workspace, allocations_before);
     }
 
 } // namespace cfm
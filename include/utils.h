@@ -232,8 +232,8 @@ namespace cfm
     }
 
     // Export map to file
-    template<class T1, class T2>
-    void exportMap(std::ofstream& file, const std::map<T1, T2>& map_data)
+    template<class Map>
+    void exportMap(std::ofstream& file, const Map& map_data)
     {
         // Check if file opened correctly
         if (!file.is_open()) {
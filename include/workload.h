@@ -0,0 +1,238 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include "utils.h"
+#include <cmath>    // sqrt, log, cos, erfc, floor, round
+#include <iomanip>  // setprecision
+#include <random>   // mt19937_64
+
+namespace cfm
+{
+
+    // Shape of a synthetic workload of clustered normal samples with injected anomalies
+    struct WorkloadParameters
+    {
+        uint64_t seed = 0;
+
+        uint16_t n_features = 11;
+        uint16_t n_clusters = 2;
+
+        uint32_t n_training = 500;
+        uint32_t n_test = 1000;
+
+        // Percentage of anomalous test samples
+        double anomaly_percent = 50;
+
+        // Standard deviation of every feature around its cluster's center
+        double spread = 0.05;
+
+        // Anomalous features are moved this many spreads away from their cluster's center
+        double shift = 4;
+        uint16_t n_anomalous_features = 3;
+
+        // Precompute the samples queue, the untrained global lists and the critical values as well
+        bool lists = true;
+        uint16_t n_presenters_sets = 10;
+        double max_nu = 0.2;
+    };
+
+    // Uniform number in [0, 1), derived from raw engine output since standard distributions differ between libraries
+    double getUniform(std::mt19937_64& engine)
+    {
+        return (engine() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Uniform index below n
+    uint64_t getUniformIndex(std::mt19937_64& engine, uint64_t const& n)
+    {
+        return (uint64_t)(getUniform(engine) * n);
+    }
+
+    // Standard normal number (Box-Muller)
+    double getNormal(std::mt19937_64& engine)
+    {
+        double const u1 = 1 - getUniform(engine);
+        double const u2 = getUniform(engine);
+        return std::sqrt(-2 * std::log(u1)) * std::cos(2 * M_PI * u2);
+    }
+
+    // Standard normal value with an upper tail probability p
+    double getNormalUpperQuantile(double const& p)
+    {
+        // Bisection on the upper tail probability
+        double low = -10;
+        double high = 10;
+        for (uint16_t i = 0; i < 100; ++i) {
+            double const middle = (low + high) / 2;
+            if (0.5 * std::erfc(middle / std::sqrt(2.0)) > p) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+
+        return (low + high) / 2;
+    }
+
+    // Write a sample as a CSV row
+    void writeSample(std::ofstream& file, const std::vector<double>& sample)
+    {
+        for (uint16_t i = 0; i < sample.size(); ++i) {
+            file << (i > 0 ? "," : "") << sample[i];
+        }
+        file << '\n';
+    }
+
+    // Draw a normal sample of a cluster
+    void drawNormalSample(std::mt19937_64& engine, WorkloadParameters const& parameters, const std::vector<double>& center, std::vector<double>& sample)
+    {
+        for (uint16_t feature = 0; feature < parameters.n_features; ++feature) {
+            sample[feature] = center[feature] + parameters.spread * getNormal(engine);
+        }
+    }
+
+    // Draw a cluster's sample and move some of its features away from the cluster
+    void drawAnomalousSample(std::mt19937_64& engine, WorkloadParameters const& parameters, const std::vector<double>& center, std::vector<double>& sample, std::vector<uint16_t>& features)
+    {
+        drawNormalSample(engine, parameters, center, sample);
+
+        // Partial Fisher-Yates shuffle picks distinct features
+        std::iota(features.begin(), features.end(), 0);
+        for (uint16_t i = 0; i < parameters.n_anomalous_features; ++i) {
+            std::swap(features[i], features[i + getUniformIndex(engine, parameters.n_features - i)]);
+            double const direction = getUniform(engine) < 0.5 ? -1 : 1;
+            sample[features[i]] = center[features[i]] + direction * parameters.shift * parameters.spread + parameters.spread * getNormal(engine);
+        }
+    }
+
+    // Write the detectors' untrained global lists, critical values and the training samples queue
+    void writeWorkloadLists(std::mt19937_64& engine, WorkloadParameters const& parameters, const std::vector<std::vector<double>>& centers, const std::vector<uint16_t>& labels, std::string const& output_path)
+    {
+        uint32_t const n_presenters = parameters.n_features * parameters.n_presenters_sets;
+        uint32_t const n_detectors = n_presenters;
+
+        // Training samples grouped by cluster
+        std::ofstream samples_queue_file(output_path + "samples_queue.csv");
+        bool first = true;
+        std::vector<uint32_t> cluster_sizes(parameters.n_clusters);
+        for (uint16_t cluster = 0; cluster < parameters.n_clusters; ++cluster) {
+            for (uint32_t i = 0; i < labels.size(); ++i) {
+                if (labels[i] == cluster) {
+                    samples_queue_file << (first ? "" : ",") << i;
+                    first = false;
+                    ++cluster_sizes[cluster];
+                }
+            }
+        }
+        samples_queue_file << '\n';
+
+        // Global lists as random permutations of all signals, written one detector at a time
+        std::ofstream global_lists_file(output_path + "untrained_global_lists.csv");
+        std::vector<uint32_t> global_list(2 * n_presenters);
+        for (uint32_t detector = 0; detector < n_detectors; ++detector) {
+            std::iota(global_list.begin(), global_list.end(), 0);
+            for (uint32_t i = global_list.size() - 1; i > 0; --i) {
+                std::swap(global_list[i], global_list[getUniformIndex(engine, i + 1)]);
+            }
+            for (uint32_t i = 0; i < global_list.size(); ++i) {
+                global_lists_file << (i > 0 ? "," : "") << global_list[i];
+            }
+            global_lists_file << '\n';
+        }
+
+        // Detectors are split evenly between clusters, and their critical values are the cluster's quantiles that leave
+        // a random nu of its samples out, as the empirical order statistics of the critical values script would
+        std::vector<std::vector<double>> left_criticals(n_detectors, std::vector<double>(parameters.n_features));
+        std::vector<std::vector<double>> right_criticals(n_detectors, std::vector<double>(parameters.n_features));
+        uint32_t const detectors_per_cluster = (n_detectors + parameters.n_clusters - 1) / parameters.n_clusters;
+        for (uint32_t detector = 0; detector < n_detectors; ++detector) {
+            uint16_t const cluster = detector / detectors_per_cluster;
+            double const nu = getUniform(engine) * parameters.max_nu;
+            uint32_t const n_samples_out = std::floor((std::max<uint32_t>(cluster_sizes[cluster], 1) - 1) * nu / 2);
+            double const z = getNormalUpperQuantile((n_samples_out + 0.5) / std::max<uint32_t>(cluster_sizes[cluster], 1));
+            for (uint16_t feature = 0; feature < parameters.n_features; ++feature) {
+                left_criticals[detector][feature] = centers[cluster][feature] - z * parameters.spread;
+                right_criticals[detector][feature] = centers[cluster][feature] + z * parameters.spread;
+            }
+        }
+
+        // Shuffle critical values between detectors by feature, as the shuffling script does
+        for (uint16_t feature = 0; feature < parameters.n_features; ++feature) {
+            for (uint32_t detector = 0; detector < n_detectors; ++detector) {
+                uint32_t const random_detector = getUniformIndex(engine, n_detectors);
+                std::swap(left_criticals[detector][feature], left_criticals[random_detector][feature]);
+                std::swap(right_criticals[detector][feature], right_criticals[random_detector][feature]);
+            }
+        }
+
+        std::ofstream left_criticals_file(output_path + "left_criticals.csv");
+        std::ofstream right_criticals_file(output_path + "right_criticals.csv");
+        left_criticals_file << std::fixed << std::setprecision(6);
+        right_criticals_file << std::fixed << std::setprecision(6);
+        for (uint32_t detector = 0; detector < n_detectors; ++detector) {
+            writeSample(left_criticals_file, left_criticals[detector]);
+            writeSample(right_criticals_file, right_criticals[detector]);
+        }
+    }
+
+    // Write a synthetic workload into a folder, streaming samples to disk as they are drawn
+    void generateWorkload(WorkloadParameters const& parameters, std::string const& output_path)
+    {
+        // Separate streams keep the samples unchanged whether the lists are written or not
+        std::mt19937_64 engine(parameters.seed);
+        std::mt19937_64 lists_engine(parameters.seed ^ 0x9E3779B97F4A7C15ULL);
+
+        // Cluster centers away from the borders of the unit hypercube
+        std::vector<std::vector<double>> centers(parameters.n_clusters, std::vector<double>(parameters.n_features));
+        for (auto& center : centers) {
+            for (auto& value : center) {
+                value = 0.2 + 0.6 * getUniform(engine);
+            }
+        }
+
+        std::vector<double> sample(parameters.n_features);
+        std::vector<uint16_t> features(parameters.n_features);
+
+        // Training set of normal samples and their clusters
+        std::ofstream training_file(output_path + "training_set.csv");
+        std::ofstream labels_file(output_path + "labels.csv");
+        training_file << std::fixed << std::setprecision(6);
+        std::vector<uint16_t> labels(parameters.n_training);
+        for (uint32_t i = 0; i < parameters.n_training; ++i) {
+            labels[i] = getUniformIndex(engine, parameters.n_clusters);
+            drawNormalSample(engine, parameters, centers[labels[i]], sample);
+            writeSample(training_file, sample);
+            labels_file << (i > 0 ? "," : "") << labels[i] + 1;
+        }
+        labels_file << '\n';
+
+        // Test set with the anomalous samples at shuffled positions, so any prefix of it mixes both classes
+        std::ofstream test_file(output_path + "test_set.csv");
+        std::ofstream classes_file(output_path + "test_set_classes.csv");
+        test_file << std::fixed << std::setprecision(6);
+        uint32_t const n_anomalies = std::round(parameters.n_test * parameters.anomaly_percent / 100);
+        std::vector<uint8_t> anomalous_samples(parameters.n_test);
+        std::fill(anomalous_samples.end() - n_anomalies, anomalous_samples.end(), 1);
+        for (uint32_t i = parameters.n_test; i > 1; --i) {
+            std::swap(anomalous_samples[i - 1], anomalous_samples[getUniformIndex(engine, i)]);
+        }
+        for (uint32_t i = 0; i < parameters.n_test; ++i) {
+            uint16_t const cluster = getUniformIndex(engine, parameters.n_clusters);
+            bool const anomalous = anomalous_samples[i];
+            if (anomalous) {
+                drawAnomalousSample(engine, parameters, centers[cluster], sample, features);
+            } else {
+                drawNormalSample(engine, parameters, centers[cluster], sample);
+            }
+            writeSample(test_file, sample);
+            classes_file << (anomalous ? 1 : -1) << '\n';
+        }
+
+        if (parameters.lists) {
+            writeWorkloadLists(lists_engine, parameters, centers, labels, output_path);
+        }
+    }
+
+} // namespace cfm
+
+#endif // WORKLOAD_H
@@ -0,0 +1,254 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include "utils.h"
+#include <atomic>   // atomic
+#include <new>      // bad_alloc
+#include <numeric>  // iota
+
+// Count every heap allocation when built with -DCFM_COUNT_ALLOCATIONS
+#ifdef CFM_COUNT_ALLOCATIONS
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace cfm
+{
+    std::atomic<uint64_t> allocation_count(0);
+}
+
+void* operator new(std::size_t size)
+{
+    cfm::allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+#endif
+
+namespace cfm
+{
+
+    // Number of heap allocations so far (always zero unless counting is enabled)
+    uint64_t getAllocationCount()
+    {
+#ifdef CFM_COUNT_ALLOCATIONS
+        return allocation_count.load(std::memory_order_relaxed);
+#else
+        return 0;
+#endif
+    }
+
+    // Per-thread list of released nodes of the same size
+    template<std::size_t Size>
+    struct NodeFreeList
+    {
+        void* head = nullptr;
+
+        // Return the unused nodes when the thread exits
+        ~NodeFreeList()
+        {
+            while (head != nullptr) {
+                void* next = *static_cast<void**>(head);
+                ::operator delete(head);
+                head = next;
+            }
+        }
+    };
+
+    // Get the calling thread's free list for nodes of a given size
+    template<std::size_t Size>
+    NodeFreeList<Size>& getNodeFreeList()
+    {
+        static thread_local NodeFreeList<Size> free_list;
+        return free_list;
+    }
+
+    // Allocator recycling single nodes, so maps cleared between samples stop hitting the heap
+    template<class T>
+    struct NodePoolAllocator
+    {
+        using value_type = T;
+
+        NodePoolAllocator() = default;
+
+        template<class U>
+        NodePoolAllocator(NodePoolAllocator<U> const&) {}
+
+        T* allocate(std::size_t n)
+        {
+            if (n == 1 && sizeof(T) >= sizeof(void*)) {
+                NodeFreeList<sizeof(T)>& free_list = getNodeFreeList<sizeof(T)>();
+                if (free_list.head != nullptr) {
+                    void* node = free_list.head;
+                    free_list.head = *static_cast<void**>(node);
+                    return static_cast<T*>(node);
+                }
+            }
+
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+
+        void deallocate(T* ptr, std::size_t n)
+        {
+            if (n == 1 && sizeof(T) >= sizeof(void*)) {
+                NodeFreeList<sizeof(T)>& free_list = getNodeFreeList<sizeof(T)>();
+                *reinterpret_cast<void**>(ptr) = free_list.head;
+                free_list.head = ptr;
+                return;
+            }
+
+            ::operator delete(ptr);
+        }
+    };
+
+    template<class T, class U>
+    bool operator==(NodePoolAllocator<T> const&, NodePoolAllocator<U> const&)
+    {
+        return true;
+    }
+
+    template<class T, class U>
+    bool operator!=(NodePoolAllocator<T> const&, NodePoolAllocator<U> const&)
+    {
+        return false;
+    }
+
+    // Registered matching lifetimes and their number of occurrences
+    using TausMap = std::map<uint16_t, uint32_t, std::less<uint16_t>, NodePoolAllocator<std::pair<const uint16_t, uint32_t>>>;
+
+    struct Agents;
+    struct RoundWorkers;
+    struct LiveMetrics;
+
+    // Sample change kernel specialized for a model shape
+    using ChangeSampleKernel = void (*)(Agents&, const std::vector<float>&);
+
+    // Interaction pair of a presenter without a detector
+    uint16_t const NO_DETECTOR = UINT16_MAX;
+
+    // Scratch storage owned by the caller and reused by every training and monitoring call
+    struct Workspace
+    {
+        // Interactions queue (indices = priority; elements = interaction pairs)
+        std::vector<uint16_t> interactions_queue;
+
+        // Interaction pairs (indices = presenters' ids; elements = detectors' ids)
+        std::vector<uint16_t> interaction_pairs;
+
+        // Random words drawn at once for a round's shuffles
+        std::vector<uint64_t> random_words;
+
+        // Shuffle with the permutation engine instead of the legacy std::shuffle draws
+        bool fast_shuffle = false;
+
+        // Dissociation probabilities drawn every round
+        std::vector<uint16_t> dissociation_probabilities;
+
+        // Signature of the current sample
+        std::vector<uint32_t> signature;
+
+        // Features a detector sees as abnormal in the current sample
+        std::vector<uint16_t> signal_out;
+
+        // Signals ordered by rank, used when compacting detectors' global lists
+        std::vector<uint16_t> rank_order;
+
+        // Interactions of the current batch and those deferred to later batches of a round
+        std::vector<uint16_t> batch_interactions;
+        std::vector<uint16_t> deferred_interactions;
+
+        // Batch in which each agent was last claimed by an interaction
+        std::vector<uint32_t> agent_claims;
+
+        // Batch counter stamping the claims
+        uint32_t batch_stamp = 0;
+
+        // Threads running the batches of interaction rounds (null runs rounds serially)
+        RoundWorkers* round_workers = nullptr;
+
+        // Live progress counters shared by every worker (null reports nothing)
+        LiveMetrics* metrics = nullptr;
+
+        // Dissociations since the counter was last reset
+        uint32_t dissociations = 0;
+
+        // Educated detectors since the counter was last reset
+        uint32_t educations = 0;
+
+        // Specialized sample change kernel (null when the shape has none)
+        ChangeSampleKernel change_sample_kernel = nullptr;
+
+        // Whether the sample change kernel was already selected
+        bool kernel_selected = false;
+
+        // Heap allocations inside the simulation loops (only counted with CFM_COUNT_ALLOCATIONS)
+        uint64_t hot_path_allocations = 0;
+
+        // Heap allocations inside the simulation loops of the last call
+        uint64_t last_call_allocations = 0;
+
+        // Number of training and monitoring calls
+        uint64_t calls = 0;
+    };
+
+    // Preallocate all scratch storage for a model shape
+    Workspace initWorkspace(uint16_t const& n_agents, uint16_t const& n_presenters, uint16_t const& n_features)
+    {
+        Workspace workspace;
+
+        workspace.interactions_queue.resize(n_presenters);
+        workspace.interaction_pairs.resize(n_presenters);
+        workspace.random_words.resize(n_presenters);
+        workspace.dissociation_probabilities.resize(n_agents);
+        workspace.signature.resize(n_features);
+        workspace.signal_out.resize(n_features);
+        workspace.rank_order.resize(2 * n_presenters);
+        workspace.batch_interactions.reserve(n_presenters);
+        workspace.deferred_interactions.reserve(n_presenters);
+        workspace.agent_claims.resize(n_agents);
+
+        return workspace;
+    }
+
+    // Fit the per-agent storage to a model whose detectors were pruned, the random draws per round follow the number of agents
+    void resizeWorkspaceAgents(Workspace& workspace, uint16_t const& n_agents)
+    {
+        workspace.dissociation_probabilities.resize(n_agents);
+        workspace.agent_claims.resize(n_agents);
+
+        // The specialized sample change kernels only fit unpruned models
+        workspace.kernel_selected = false;
+    }
+
+    // Restore the interactions queue and pairs to their initial order, presenters beyond the detectors of a pruned model are paired with none
+    void resetWorkspaceInteractions(Workspace& workspace, uint16_t const& n_presenters, uint16_t const& n_detectors)
+    {
+        std::iota(workspace.interactions_queue.begin(), workspace.interactions_queue.end(), 0);
+        uint16_t const n_paired = std::min(n_presenters, n_detectors);
+        std::iota(workspace.interaction_pairs.begin(), workspace.interaction_pairs.begin() + n_paired, n_presenters);
+        std::fill(workspace.interaction_pairs.begin() + n_paired, workspace.interaction_pairs.end(), NO_DETECTOR);
+    }
+
+    // Register the allocations made inside a call's simulation loop
+    void registerHotPathAllocations(Workspace& workspace, uint64_t const& allocations_before)
+    {
+        workspace.last_call_allocations = getAllocationCount() - allocations_before;
+        workspace.hot_path_allocations += workspace.last_call_allocations;
+        ++workspace.calls;
+    }
+
+} // namespace cfm
+
+#endif // WORKSPACE_H
@@ -0,0 +1,470 @@
+#include "../include/cfm_api.h"
+#include "../include/utils.h"
+#include "../include/cfmodel.h"
+#include "../include/training.h"
+#include "../include/monitoring.h"
+#include "../include/signatures.h"
+#include "../include/snapshot.h"
+#include <cstring>  // memcpy
+
+using namespace cfm;
+
+// Model handle behind the C API
+struct cfm_model
+{
+    cfm_parameters parameters;
+
+    uint16_t n_features;
+    uint16_t n_presenters_sets;
+    uint16_t n_presenters;
+
+    Agents agents;
+
+    // Breakpoint index of the detectors' critical values
+    SignatureIndex signature_index;
+
+    // Calibration results
+    bool calibrated;
+    uint16_t activation_tau;
+};
+
+// Immutable model version served by a scorer
+struct ScorerVersion
+{
+    cfm_model model;
+    uint64_t version;
+};
+
+// Scorer handle behind the C API
+struct cfm_scorer
+{
+    uint16_t n_features;
+
+    SnapshotCell<ScorerVersion> versions;
+
+    // Serializes publishers so versions are numbered in publication order
+    std::mutex publish_mutex;
+    uint64_t last_version;
+};
+
+namespace
+{
+
+    // Serialized model header
+    char const MODEL_MAGIC[4] = {'C', 'F', 'M', 'M'};
+    uint32_t const MODEL_VERSION = 2;
+
+    // Copy a row-major matrix into per-detector rows
+    template<class T>
+    std::vector<std::vector<T>> toRows(T const* values, std::size_t const& n_rows, std::size_t const& n_columns)
+    {
+        std::vector<std::vector<T>> rows(n_rows);
+        for (std::size_t i = 0; i < n_rows; ++i) {
+            rows.at(i).assign(values + i * n_columns, values + (i + 1) * n_columns);
+        }
+
+        return rows;
+    }
+
+    // Build a model from its detectors' lists
+    cfm_model* createModel(uint16_t const& n_features, uint16_t const& n_presenters_sets, const std::vector<std::vector<uint16_t>>& global_lists, const std::vector<std::vector<float>>& left_criticals, const std::vector<std::vector<float>>& right_criticals, cfm_parameters const& parameters)
+    {
+        cfm_model* model = new cfm_model();
+        model->parameters = parameters;
+        model->n_features = n_features;
+        model->n_presenters_sets = n_presenters_sets;
+        model->n_presenters = n_features * n_presenters_sets;
+        model->agents = initAgents(2 * model->n_presenters);
+        model->calibrated = false;
+        model->activation_tau = 0;
+
+        initDetectorsGlobalLists(model->agents, model->n_presenters, global_lists);
+        initDetectorsCriticalLists(model->agents, model->n_presenters, left_criticals, right_criticals);
+        model->signature_index = buildSignatureIndex(model->agents, model->n_presenters, n_features);
+
+        return model;
+    }
+
+    // Check that a model's shape fits the simulation's 16-bit agent ids
+    bool isValidShape(uint16_t const& n_features, uint16_t const& n_presenters_sets)
+    {
+        uint32_t const n_presenters = (uint32_t)n_features * n_presenters_sets;
+        return n_presenters > 0 && 2 * n_presenters <= INT16_MAX;
+    }
+
+    // Check that the parameters never make the simulation loops divide by zero
+    bool isValidParameters(cfm_parameters const& parameters)
+    {
+        return parameters.sample_rounds > 0 && parameters.training_interval > 0;
+    }
+
+    // Check that a training queue only visits stored samples
+    bool isValidQueue(const uint16_t* samples_queue, uint32_t const& n_samples)
+    {
+        return samples_queue == nullptr || std::all_of(samples_queue, samples_queue + n_samples, [&](uint16_t const& i) { return i < n_samples; });
+    }
+
+    // Append a value's bytes to a buffer
+    template<class T>
+    void putBytes(std::vector<char>& buffer, T const* values, std::size_t const& count)
+    {
+        char const* bytes = reinterpret_cast<char const*>(values);
+        buffer.insert(buffer.end(), bytes, bytes + count * sizeof(T));
+    }
+
+    // Read a value's bytes from a buffer, return false past its end
+    template<class T>
+    bool getBytes(char const*& cursor, char const* end, T* values, std::size_t const& count)
+    {
+        std::size_t const size = count * sizeof(T);
+        if ((std::size_t)(end - cursor) < size) {
+            return false;
+        }
+        std::memcpy(values, cursor, size);
+        cursor += size;
+
+        return true;
+    }
+
+    // Scratch storage for simulations of a model's agents, shuffling as the model's parameters ask
+    Workspace initModelWorkspace(cfm_model const& model, Agents const& agents)
+    {
+        Workspace workspace = initWorkspace(agents.id.size(), model.n_presenters, model.n_features);
+        workspace.fast_shuffle = model.parameters.fast_shuffle;
+
+        return workspace;
+    }
+
+    // Score a sample on agents copied from a model
+    uint32_t scoreModelSample(cfm_model const& model, Agents& agents, Workspace& workspace, std::vector<float>& sample, const float* values)
+    {
+        sample.assign(values, values + model.n_features);
+        return scoreSample(agents, workspace, model.n_presenters, model.parameters.monitoring_rounds, model.n_features, sample, model.activation_tau, &model.signature_index);
+    }
+
+} // namespace
+
+cfm_parameters cfm_default_parameters(void)
+{
+    cfm_parameters parameters;
+    parameters.seed = 0;
+    parameters.sample_rounds = 100;
+    parameters.training_rounds = 1000000;
+    parameters.training_interval = 1500;
+    parameters.monitoring_rounds = 1000;
+    parameters.activation_threshold_percent = 5;
+    parameters.fast_shuffle = 0;
+
+    return parameters;
+}
+
+cfm_model* cfm_model_create(uint16_t n_features, uint16_t n_presenters_sets, const uint16_t* global_lists, const float* left_criticals, const float* right_criticals, const cfm_parameters* parameters)
+{
+    if (global_lists == nullptr || left_criticals == nullptr || right_criticals == nullptr || parameters == nullptr || !isValidShape(n_features, n_presenters_sets)) {
+        return nullptr;
+    }
+    if (!isValidParameters(*parameters)) {
+        return nullptr;
+    }
+
+    try {
+        uint16_t const n_presenters = n_features * n_presenters_sets;
+        return createModel(n_features, n_presenters_sets, toRows(global_lists, n_presenters, 2 * n_presenters), toRows(left_criticals, n_presenters, n_features), toRows(right_criticals, n_presenters, n_features), *parameters);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void cfm_model_free(cfm_model* model)
+{
+    delete model;
+}
+
+cfm_status cfm_model_train(cfm_model* model, const float* samples, uint32_t n_samples, const uint16_t* samples_queue)
+{
+    if (model == nullptr || samples == nullptr || n_samples == 0 || n_samples > UINT16_MAX || !isValidQueue(samples_queue, n_samples)) {
+        return CFM_ERROR_ARGUMENT;
+    }
+
+    try {
+        const std::vector<std::vector<float>> data_set = toRows(samples, n_samples, model->n_features);
+
+        std::vector<uint16_t> queue(n_samples);
+        if (samples_queue != nullptr) {
+            queue.assign(samples_queue, samples_queue + n_samples);
+        } else {
+            std::iota(queue.begin(), queue.end(), 0);
+        }
+
+        Workspace workspace = initModelWorkspace(*model, model->agents);
+        training(model->agents, workspace, model->n_presenters, model->parameters.training_rounds, model->parameters.sample_rounds, n_samples, queue, model->n_features, data_set, model->parameters.training_interval, true, model->parameters.seed);
+
+        // Trained global lists are kept as dense ranks
+        compactDetectorsGlobalLists(model->agents, model->n_presenters);
+
+        // Reset some of the agents' data structures
+        resetAgentsMatch(model->agents);
+        resetAgentsTau(model->agents);
+        resetAgentsTausMap(model->agents);
+
+        // Retrained detectors need a new calibration
+        model->calibrated = false;
+    } catch (...) {
+        return CFM_ERROR_INTERNAL;
+    }
+
+    return CFM_OK;
+}
+
+cfm_status cfm_model_calibrate(cfm_model* model, const float* normal_samples, uint32_t n_normal_samples)
+{
+    if (model == nullptr || normal_samples == nullptr || n_normal_samples == 0 || n_normal_samples > UINT16_MAX) {
+        return CFM_ERROR_ARGUMENT;
+    }
+
+    try {
+        const std::vector<std::vector<float>> samples = toRows(normal_samples, n_normal_samples, model->n_features);
+
+        // Equivalent samples are simulated once
+        const std::vector<uint16_t> equivalent_samples = findEquivalentSamples(model->signature_index, samples);
+        std::vector<uint16_t> normal_multiplicity(n_normal_samples);
+        for (auto const& i : equivalent_samples) {
+            ++normal_multiplicity.at(i);
+        }
+
+        Workspace workspace = initModelWorkspace(*model, model->agents);
+        model->activation_tau = calibration(model->agents, workspace, model->n_presenters, model->parameters.monitoring_rounds, model->n_features, samples, normal_multiplicity, model->parameters.activation_threshold_percent, model->signature_index);
+        model->calibrated = true;
+    } catch (...) {
+        return CFM_ERROR_INTERNAL;
+    }
+
+    return CFM_OK;
+}
+
+cfm_status cfm_model_score(const cfm_model* model, const float* samples, uint32_t n_samples, uint32_t* responses)
+{
+    if (model == nullptr || (n_samples > 0 && (samples == nullptr || responses == nullptr))) {
+        return CFM_ERROR_ARGUMENT;
+    }
+    if (!model->calibrated) {
+        return CFM_ERROR_STATE;
+    }
+
+    try {
+        // Each call simulates on its own copy of the agents, so concurrent calls never share state
+        Agents agents = model->agents;
+        Workspace workspace = initModelWorkspace(*model, agents);
+
+        std::vector<float> sample(model->n_features);
+        for (uint32_t i = 0; i < n_samples; ++i) {
+            responses[i] = scoreModelSample(*model, agents, workspace, sample, samples + (std::size_t)i * model->n_features);
+        }
+    } catch (...) {
+        return CFM_ERROR_INTERNAL;
+    }
+
+    return CFM_OK;
+}
+
+cfm_status cfm_model_global_lists(const cfm_model* model, uint16_t* global_lists)
+{
+    if (model == nullptr || global_lists == nullptr) {
+        return CFM_ERROR_ARGUMENT;
+    }
+
+    for (uint16_t i = model->n_presenters; i < model->agents.id.size(); ++i) {
+        global_lists = std::copy(model->agents.global_list.at(i).begin(), model->agents.global_list.at(i).end(), global_lists);
+    }
+
+    return CFM_OK;
+}
+
+size_t cfm_model_serialize(const cfm_model* model, void* buffer, size_t size)
+{
+    if (model == nullptr) {
+        return 0;
+    }
+
+    std::vector<char> bytes;
+    putBytes(bytes, MODEL_MAGIC, 4);
+    putBytes(bytes, &MODEL_VERSION, 1);
+    putBytes(bytes, &model->n_features, 1);
+    putBytes(bytes, &model->n_presenters_sets, 1);
+    putBytes(bytes, &model->parameters.seed, 1);
+    putBytes(bytes, &model->parameters.sample_rounds, 1);
+    putBytes(bytes, &model->parameters.training_rounds, 1);
+    putBytes(bytes, &model->parameters.training_interval, 1);
+    putBytes(bytes, &model->parameters.monitoring_rounds, 1);
+    putBytes(bytes, &model->parameters.activation_threshold_percent, 1);
+    putBytes(bytes, &model->parameters.fast_shuffle, 1);
+
+    uint8_t const calibrated = model->calibrated;
+    putBytes(bytes, &calibrated, 1);
+    putBytes(bytes, &model->activation_tau, 1);
+
+    for (uint16_t i = model->n_presenters; i < model->agents.id.size(); ++i) {
+        putBytes(bytes, model->agents.global_list.at(i).data(), model->agents.global_list.at(i).size());
+        // Critical values are always serialized as floats, whatever their storage type
+        const std::vector<float> left_criticals(model->agents.left_criticals.at(i).begin(), model->agents.left_criticals.at(i).end());
+        const std::vector<float> right_criticals(model->agents.right_criticals.at(i).begin(), model->agents.right_criticals.at(i).end());
+        putBytes(bytes, left_criticals.data(), model->n_features);
+        putBytes(bytes, right_criticals.data(), model->n_features);
+        putBytes(bytes, &model->agents.activation_thresholds.at(i), 1);
+    }
+
+    if (buffer != nullptr && size >= bytes.size()) {
+        std::memcpy(buffer, bytes.data(), bytes.size());
+    }
+
+    return bytes.size();
+}
+
+cfm_model* cfm_model_deserialize(const void* buffer, size_t size)
+{
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+
+    try {
+        char const* cursor = static_cast<char const*>(buffer);
+        char const* end = cursor + size;
+
+        char magic[4];
+        uint32_t version = 0;
+        uint16_t n_features = 0, n_presenters_sets = 0;
+        cfm_parameters parameters = cfm_default_parameters();
+        uint8_t calibrated = 0;
+        uint16_t activation_tau = 0;
+
+        bool valid = getBytes(cursor, end, magic, 4) && std::memcmp(magic, MODEL_MAGIC, 4) == 0
+            && getBytes(cursor, end, &version, 1) && version >= 1 && version <= MODEL_VERSION
+            && getBytes(cursor, end, &n_features, 1)
+            && getBytes(cursor, end, &n_presenters_sets, 1)
+            && getBytes(cursor, end, &parameters.seed, 1)
+            && getBytes(cursor, end, &parameters.sample_rounds, 1)
+            && getBytes(cursor, end, &parameters.training_rounds, 1)
+            && getBytes(cursor, end, &parameters.training_interval, 1)
+            && getBytes(cursor, end, &parameters.monitoring_rounds, 1)
+            && getBytes(cursor, end, &parameters.activation_threshold_percent, 1)
+            && (version < 2 || getBytes(cursor, end, &parameters.fast_shuffle, 1))
+            && getBytes(cursor, end, &calibrated, 1)
+            && getBytes(cursor, end, &activation_tau, 1)
+            && isValidShape(n_features, n_presenters_sets)
+            && isValidParameters(parameters);
+        if (!valid) {
+            return nullptr;
+        }
+
+        uint16_t const n_presenters = n_features * n_presenters_sets;
+        std::vector<std::vector<uint16_t>> global_lists(n_presenters, std::vector<uint16_t>(2 * n_presenters));
+        std::vector<std::vector<float>> left_criticals(n_presenters, std::vector<float>(n_features));
+        std::vector<std::vector<float>> right_criticals(n_presenters, std::vector<float>(n_features));
+        std::vector<uint32_t> activation_thresholds(n_presenters);
+        for (uint16_t i = 0; i < n_presenters; ++i) {
+            valid = getBytes(cursor, end, global_lists.at(i).data(), global_lists.at(i).size())
+                && getBytes(cursor, end, left_criticals.at(i).data(), n_features)
+                && getBytes(cursor, end, right_criticals.at(i).data(), n_features)
+                && getBytes(cursor, end, &activation_thresholds.at(i), 1);
+            if (!valid) {
+                return nullptr;
+            }
+        }
+
+        cfm_model* model = createModel(n_features, n_presenters_sets, global_lists, left_criticals, right_criticals, parameters);
+        std::copy(activation_thresholds.begin(), activation_thresholds.end(), model->agents.activation_thresholds.begin() + n_presenters);
+        model->calibrated = calibrated;
+        model->activation_tau = activation_tau;
+
+        return model;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+cfm_scorer* cfm_scorer_create(const cfm_model* model)
+{
+    if (model == nullptr || !model->calibrated) {
+        return nullptr;
+    }
+
+    try {
+        cfm_scorer* scorer = new cfm_scorer();
+        scorer->n_features = model->n_features;
+        scorer->last_version = 0;
+        if (cfm_scorer_publish(scorer, model) != CFM_OK) {
+            delete scorer;
+            return nullptr;
+        }
+
+        return scorer;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void cfm_scorer_free(cfm_scorer* scorer)
+{
+    delete scorer;
+}
+
+cfm_status cfm_scorer_publish(cfm_scorer* scorer, const cfm_model* model)
+{
+    if (scorer == nullptr || model == nullptr || model->n_features != scorer->n_features) {
+        return CFM_ERROR_ARGUMENT;
+    }
+    if (!model->calibrated) {
+        return CFM_ERROR_STATE;
+    }
+
+    try {
+        // The snapshot is copied outside the publishers' lock, readers never wait for either
+        ScorerVersion* snapshot = new ScorerVersion{*model, 0};
+
+        std::lock_guard<std::mutex> lock(scorer->publish_mutex);
+        snapshot->version = ++scorer->last_version;
+        publishSnapshot(scorer->versions, static_cast<ScorerVersion const*>(snapshot));
+    } catch (...) {
+        return CFM_ERROR_INTERNAL;
+    }
+
+    return CFM_OK;
+}
+
+cfm_status cfm_scorer_score(cfm_scorer* scorer, const float* samples, uint32_t n_samples, uint32_t* responses, uint64_t* versions)
+{
+    if (scorer == nullptr || (n_samples > 0 && (samples == nullptr || responses == nullptr))) {
+        return CFM_ERROR_ARGUMENT;
+    }
+
+    uint16_t const slot = reserveSnapshotSlot(scorer->versions);
+    cfm_status status = CFM_OK;
+
+    try {
+        // Agents are copied again only when a sample picks up a new version
+        ScorerVersion const* pinned = nullptr;
+        Agents agents;
+        Workspace workspace;
+        std::vector<float> sample(scorer->n_features);
+
+        for (uint32_t i = 0; i < n_samples; ++i) {
+            ScorerVersion const* current = pinSnapshot(scorer->versions, slot);
+            if (current != pinned) {
+                pinned = current;
+                agents = pinned->model.agents;
+                workspace = initModelWorkspace(pinned->model, agents);
+            }
+
+            responses[i] = scoreModelSample(pinned->model, agents, workspace, sample, samples + (std::size_t)i * scorer->n_features);
+            if (versions != nullptr) {
+                versions[i] = pinned->version;
+            }
+        }
+    } catch (...) {
+        status = CFM_ERROR_INTERNAL;
+    }
+
+    releaseSnapshotSlot(scorer->versions, slot);
+
+    return status;
+}
@@ -0,0 +1,71 @@
+#include "../include/kernels.h"
+#include <chrono>   // steady_clock, duration
+
+using namespace cfm;
+
+// Time a sample change kernel over every sample, return the elapsed seconds
+template<class Function>
+double timeSampleChanges(const std::vector<std::vector<float>>& samples, Function&& change_sample)
+{
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    for (auto const& sample : samples) {
+        change_sample(sample);
+    }
+
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Compare the specialized sample change kernel of a model shape with the generic one on random samples and criticals
+int main(int argc, char* argv[])
+{
+    if (argc > 4) {
+        std::cout << "Usage: " << argv[0] << " [features] [presenters sets] [samples]" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    uint16_t const n_features = argc > 1 ? std::stoul(argv[1]) : 11;
+    uint16_t const n_presenters_sets = argc > 2 ? std::stoul(argv[2]) : 10;
+    uint32_t const n_samples = argc > 3 ? std::stoul(argv[3]) : 200000;
+    uint16_t const n_presenters = n_features * n_presenters_sets;
+
+    ChangeSampleKernel const kernel = selectChangeSampleKernel(n_presenters, n_features);
+    if (kernel == nullptr) {
+        std::cout << "No specialized kernel for " << n_features << " features x " << n_presenters_sets << " presenters sets, add the shape to CFM_KERNEL_SHAPES" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    // Random critical values around the middle of the unit interval
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<float> unit(0, 1);
+    std::vector<std::vector<float>> left_criticals(n_presenters, std::vector<float>(n_features));
+    std::vector<std::vector<float>> right_criticals(n_presenters, std::vector<float>(n_features));
+    for (uint16_t i = 0; i < n_presenters; ++i) {
+        for (uint16_t j = 0; j < n_features; ++j) {
+            left_criticals.at(i).at(j) = 0.4f * unit(generator);
+            right_criticals.at(i).at(j) = 0.6f + 0.4f * unit(generator);
+        }
+    }
+
+    std::vector<std::vector<float>> samples(n_samples, std::vector<float>(n_features));
+    for (auto& sample : samples) {
+        std::generate(sample.begin(), sample.end(), [&]{ return unit(generator); });
+    }
+
+    Agents generic_agents = initAgents(n_presenters, n_presenters);
+    initDetectorsCriticalLists(generic_agents, n_presenters, left_criticals, right_criticals);
+    Agents fixed_agents = generic_agents;
+
+    double const generic_seconds = timeSampleChanges(samples, [&](const std::vector<float>& sample) { changeSample(generic_agents, n_presenters, n_features, sample); });
+    double const fixed_seconds = timeSampleChanges(samples, [&](const std::vector<float>& sample) { kernel(fixed_agents, sample); });
+
+    // Both kernels must leave the same signals and local lists after the last sample
+    bool const identical = generic_agents.signal == fixed_agents.signal && generic_agents.local_list == fixed_agents.local_list;
+
+    std::cout << n_samples << " sample changes on " << n_features << " features x " << n_presenters_sets << " presenters sets: generic " << generic_seconds << " s, specialized " << fixed_seconds << " s" << '\n';
+    if (!identical) {
+        std::cout << "Error: the specialized kernel changed the sample differently" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
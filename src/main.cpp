@@ -2,6 +2,13 @@
 #include "../include/cfmodel.h"
 #include "../include/training.h"
 #include "../include/monitoring.h"
+#include "../include/calibration.h"
+#include "../include/online.h"
+#include "../include/prune.h"
+#include "../include/signatures.h"
+#include "../include/cache.h"
+#include "../include/sharding.h"
+#include "../include/memory.h"
 
 using namespace cfm;
 
@@ -49,12 +56,52 @@ int main()
 
     initDetectorsCriticalLists(agents, n_presenters, left_criticals, right_criticals);
 
+    // Cap of registered matching lifetimes, bounding the taus maps (0 keeps every lifetime)
+    agents.tau_cap = params["tau cap"];
+
+    // Scratch storage reused by all simulations
+    Workspace workspace = initWorkspace(n_agents, n_presenters, n_features);
+    workspace.fast_shuffle = params["fast shuffle"];
+
+    // Progress and throughput exported for scrapers every interval while the job runs (0 exports nothing)
+    uint32_t const metrics_interval = params["metrics interval ms"];
+    LiveMetrics live_metrics;
+    if (metrics_interval > 0) {
+        startMetricsReporter(live_metrics, "../cellular-frustration-model/output/metrics.prom", metrics_interval);
+        workspace.metrics = &live_metrics;
+    }
+
+    // Bytes held by the agents' fields after each phase
+    bool const memory_report_flag = params["memory report"];
+    std::vector<MemoryUsage> memory_report;
+    if (memory_report_flag) {
+        recordAgentsMemory(memory_report, agents, "initialized");
+    }
+
     // -----------------/TRAINING/-----------------
 
     // Flag to execute the training portion of the program
     bool const train_flag = params["train"];
 
     if (train_flag) {
+        // Binary trace of taus maps and, optionally, round summaries
+        bool const trace_flag = params["trace"];
+        TraceWriter trace;
+        if (trace_flag) {
+            openTrace(trace, "../cellular-frustration-model/output/trace.bin", params["trace compress"], params["trace rounds"]);
+        }
+        TraceWriter* const trace_ptr = trace_flag ? &trace : nullptr;
+
+        // Prepare each next sample on a helper thread during the current sample's rounds
+        bool const pipeline_samples = params["pipeline samples"];
+
+        // Threads sharing each round's interactions, results do not depend on their number
+        RoundWorkers round_workers;
+        if (params["round threads"] > 1) {
+            startRoundWorkers(round_workers, params["round threads"]);
+            workspace.round_workers = &round_workers;
+        }
+
         // Load samples queue
         std::vector<uint16_t> samples_queue = loadUnsignedIntVector("../cellular-frustration-model/input/samples_queue.csv");
 
@@ -68,13 +115,20 @@ int main()
         uint16_t const training_interval = params["training interval"];
 
         // Dynamics with untrained detectors
-        training(agents, n_presenters, frustration_rounds, sample_rounds, n_samples, samples_queue, n_features, training_set, training_interval, false);
+        setMetricsPhase(workspace.metrics, METRICS_UNTRAINED, frustration_rounds);
+        training(agents, workspace, n_presenters, frustration_rounds, sample_rounds, n_samples, samples_queue, n_features, training_set, training_interval, false, 0, trace_ptr, pipeline_samples);
 
         // Export agents' taus
         for (auto const& agent_map : agents.taus_map) {
             exportMap(agents_taus_file, agent_map);
         }
         agents_taus_file.close();
+        if (trace_flag) {
+            recordTausMaps(trace, agents);
+        }
+        if (memory_report_flag) {
+            recordAgentsMemory(memory_report, agents, "untrained");
+        }
 
         // Reset some of the agents' data structures
         resetAgentsMatch(agents);
@@ -85,12 +139,22 @@ int main()
         uint32_t const training_rounds = params["training rounds"];
 
         // Dynamics with detectors training
-        training(agents, n_presenters, training_rounds, sample_rounds, n_samples, samples_queue, n_features, training_set, training_interval);
+        trace.phase = TRACE_TRAINING;
+        setMetricsPhase(workspace.metrics, METRICS_TRAINING, training_rounds);
+        training(agents, workspace, n_presenters, training_rounds, sample_rounds, n_samples, samples_queue, n_features, training_set, training_interval, true, 0, trace_ptr, pipeline_samples);
+
+        if (trace_flag) {
+            recordTausMaps(trace, agents);
+        }
+        if (memory_report_flag) {
+            recordAgentsMemory(memory_report, agents, "training");
+        }
 
         // File used to write all the detectors' global lists
         std::ofstream detectors_global_lists_file("../cellular-frustration-model/input/trained_global_lists.csv");
 
         // Export detectors' global lists
+        compactDetectorsGlobalLists(agents, n_presenters);
         detectors_global_lists = {agents.global_list.begin() + n_presenters, agents.global_list.end()};
         for (auto const& global_list : detectors_global_lists) {
             exportVector(detectors_global_lists_file, global_list);
@@ -102,20 +166,33 @@ int main()
         resetAgentsTausMap(agents);
 
         agents_taus_file.open("../cellular-frustration-model/output/trained_taus.csv");
+        trace.phase = TRACE_TRAINED;
+        setMetricsPhase(workspace.metrics, METRICS_TRAINED, frustration_rounds);
 
         // Dynamics with trained detectors
-        training(agents, n_presenters, frustration_rounds, sample_rounds, n_samples, samples_queue, n_features, training_set, training_interval, false);
+        training(agents, workspace, n_presenters, frustration_rounds, sample_rounds, n_samples, samples_queue, n_features, training_set, training_interval, false, 0, trace_ptr, pipeline_samples);
 
         // Export agents' taus
         for (auto const& agent_map : agents.taus_map) {
             exportMap(agents_taus_file, agent_map);
         }
         agents_taus_file.close();
+        if (trace_flag) {
+            recordTausMaps(trace, agents);
+        }
+        if (memory_report_flag) {
+            recordAgentsMemory(memory_report, agents, "trained");
+        }
 
         // Reset some of the agents' data structures
         resetAgentsMatch(agents);
         resetAgentsTau(agents);
         resetAgentsTausMap(agents);
+
+        closeTrace(trace);
+
+        stopRoundWorkers(round_workers);
+        workspace.round_workers = nullptr;
     }
 
     // -----------------/MONITORING/-----------------
@@ -148,85 +225,205 @@ int main()
         }
         const std::vector<int16_t> test_set_classes = test_set_classes_temp;
 
-        // All registered taus across calibration samples
-        std::vector<std::map<uint16_t, uint32_t>> calibration_taus_map(n_agents);
+        // Breakpoint index of the detectors' critical values
+        SignatureIndex signature_index = buildSignatureIndex(agents, n_presenters, n_features);
+
+        // First test sample with the same signature as each test sample
+        const std::vector<uint16_t> equivalent_samples = findEquivalentSamples(signature_index, test_set);
+
+        // Keep tracking the activation thresholds with the normal test samples as they are scored
+        bool const online_calibration_flag = params["online calibration"];
+
+        // Leading test samples whose normal ones calibrate the model (the online calibration streams the others)
+        uint16_t const n_calibration = online_calibration_flag ? std::min<uint16_t>(n_samples, std::max(params["online seed samples"], 1)) : n_samples;
 
-        // Activation tau calibration with normal test samples
-        for (uint16_t i = 0; i < n_samples; ++i) {
-            if (test_set_classes.at(i) != -1) {
-                continue;
+        // Number of normal test samples represented by each simulated sample
+        std::vector<uint16_t> normal_multiplicity(n_samples);
+        for (uint16_t i = 0; i < n_calibration; ++i) {
+            if (test_set_classes.at(i) == -1) {
+                ++normal_multiplicity.at(equivalent_samples.at(i));
             }
+        }
+
+        // Activation threshold percentage used to select the reference number of pairings generated for all normal test samples
+        uint16_t const activation_threshold_percent = params["activation threshold percent"];
 
-            monitoring(agents, n_presenters, monitoring_rounds, n_features, test_set.at(i));
+        // Number of worker threads used to simulate test samples
+        uint16_t const n_threads = params["threads"];
+
+        // Bound on the half-width of the activation thresholds' confidence intervals in pairings (0 calibrates with every normal test sample)
+        uint16_t const calibration_error = params["calibration error"];
+
+        // Confidence level of the sampled calibration's intervals, which have no width at 0% and no bound at 100%
+        if (calibration_error > 0 && (params["calibration confidence"] < 1 || params["calibration confidence"] > 99)) {
+            std::cout << "Error: calibration confidence must be between 1 and 99" << '\n';
+            std::exit(EXIT_FAILURE);
+        }
 
-            // Register calibration taus
-            for (auto const& id : agents.id) {
-                for (auto const& kv : agents.taus_map.at(id)) {
-                    calibration_taus_map.at(id)[kv.first] += kv.second;
+        // Number of pairings of the calibration's normal samples, which start the online calibration
+        std::vector<std::vector<uint32_t>> normal_pairings;
+        std::vector<std::vector<uint32_t>>* const calibration_pairings = online_calibration_flag ? &normal_pairings : nullptr;
+
+        // Simulated samples standing for the normal test samples, monitored once by the sampled calibration (at most) and twice by the full one
+        uint16_t const n_normal_simulated = n_samples - std::count(normal_multiplicity.begin(), normal_multiplicity.end(), 0);
+        uint64_t const calibration_work = calibration_error > 0 ? n_normal_simulated : 2 * n_normal_simulated;
+
+        // Calibrate the activation tau and the detectors' activation thresholds with normal test samples
+        setMetricsPhase(workspace.metrics, METRICS_CALIBRATION, calibration_work);
+        uint16_t activation_tau = 0;
+        if (calibration_error > 0) {
+            // Simulated sample standing for each normal test sample
+            std::vector<uint16_t> normal_samples;
+            for (uint16_t i = 0; i < n_calibration; ++i) {
+                if (test_set_classes.at(i) == -1) {
+                    normal_samples.push_back(equivalent_samples.at(i));
                 }
             }
 
-            // Reset some of the agents' data structures
-            resetAgentsMatch(agents);
-            resetAgentsTau(agents);
-            resetAgentsTausMap(agents);
-        }
+            // Grow a random subset of normal test samples until the bound is met
+            CalibrationReport calibration_report;
+            activation_tau = calibrationSampled(agents, workspace, n_presenters, monitoring_rounds, n_features, test_set, normal_samples, activation_threshold_percent, signature_index, calibration_error, params["calibration confidence"], params["calibration batch"], params["seed"], calibration_report, n_threads, calibration_pairings);
+
+            std::cout << "Calibration: " << calibration_report.n_sampled << " of " << calibration_report.n_normal << " normal samples (" << calibration_report.n_simulated << " simulated), activation thresholds within " << calibration_report.max_half_width << " pairings at " << 100 * calibration_report.confidence << "% confidence" << '\n';
 
-        // Number of normal test samples
-        uint16_t n_normal_samples = 0;
-        for (auto const& test_set_class : test_set_classes) {
-            if (test_set_class == -1) {
-                ++n_normal_samples;
+            // Export each detector's activation threshold and its confidence interval
+            std::ofstream calibration_file("../cellular-frustration-model/output/calibration_intervals.csv");
+            for (uint16_t i = 0; i < n_detectors; ++i) {
+                calibration_file << agents.activation_thresholds.at(n_presenters + i) << ',' << calibration_report.low.at(i) << ',' << calibration_report.high.at(i) << '\n';
             }
+        } else {
+            activation_tau = calibration(agents, workspace, n_presenters, monitoring_rounds, n_features, test_set, normal_multiplicity, activation_threshold_percent, signature_index, n_threads, calibration_pairings);
         }
 
-        // Compute activation tau
-        uint16_t activation_tau = computeActivationTau(agents, n_presenters, calibration_taus_map, n_normal_samples);
-        calibration_taus_map.clear();
+        // Drop the detectors that do not separate anomalous from normal test samples, then recalibrate the kept ones
+        if (params["prune detectors"]) {
+            // Largest drop of the AUC allowed by pruning
+            double const auc_tolerance = params["prune auc tolerance percent"] / 100.0;
 
-        // All number of pairings for the activation tau for all normal test samples
-        std::vector<std::vector<uint32_t>> number_pairings(n_detectors);
+            // Test samples simulated once for the contributions, then by each pruned model of the binary search along with its calibration
+            uint16_t n_simulated = 0;
+            for (uint16_t i = 0; i < n_samples; ++i) {
+                n_simulated += equivalent_samples.at(i) == i;
+            }
+            uint16_t const n_searches = std::ceil(std::log2(n_detectors));
+            setMetricsPhase(workspace.metrics, METRICS_PRUNING, n_simulated + n_searches * (n_simulated + 2 * n_normal_simulated));
+
+            PruningReport pruning_report;
+            const std::vector<uint16_t> detectors_kept = pruneModel(agents, workspace, n_presenters, monitoring_rounds, n_features, test_set, test_set_classes, equivalent_samples, normal_multiplicity, activation_threshold_percent, activation_tau, signature_index, auc_tolerance, pruning_report, n_threads);
+            signature_index = buildSignatureIndex(agents, n_presenters, n_features);
+
+            // Recalibrate the kept detectors
+            setMetricsPhase(workspace.metrics, METRICS_CALIBRATION, calibration_work);
+            if (calibration_error > 0) {
+                std::vector<uint16_t> normal_samples;
+                for (uint16_t i = 0; i < n_calibration; ++i) {
+                    if (test_set_classes.at(i) == -1) {
+                        normal_samples.push_back(equivalent_samples.at(i));
+                    }
+                }
 
-        // Activation threshold calibration with normal test samples
-        for (uint16_t i = 0; i < n_samples; ++i) {
-            if (test_set_classes.at(i) != -1) {
-                continue;
+                CalibrationReport calibration_report;
+                activation_tau = calibrationSampled(agents, workspace, n_presenters, monitoring_rounds, n_features, test_set, normal_samples, activation_threshold_percent, signature_index, calibration_error, params["calibration confidence"], params["calibration batch"], params["seed"], calibration_report, n_threads, calibration_pairings);
+            } else {
+                activation_tau = calibration(agents, workspace, n_presenters, monitoring_rounds, n_features, test_set, normal_multiplicity, activation_threshold_percent, signature_index, n_threads, calibration_pairings);
             }
 
-            monitoring(agents, n_presenters, monitoring_rounds, n_features, test_set.at(i));
+            // The detectors were chosen on the test samples that are scored next, so their AUC is optimistic
+            std::cout << "Pruning: kept " << pruning_report.n_kept << " of " << pruning_report.n_detectors << " detectors, AUC " << pruning_report.auc << " -> " << pruning_report.pruned_auc << " (" << pruning_report.n_evaluated << " pruned models simulated)" << '\n';
+            std::cout << "Warning: the pruning was tuned on the scored test set, so its AUC and the pruned model's responses overestimate the AUC on unseen samples" << '\n';
 
-            // Register the number of pairings for the activation tau
-            getNumberPairingsForActivationTau(agents, n_presenters, number_pairings, activation_tau);
+            // Export the kept detectors (original indices) and the compacted model
+            std::ofstream pruned_detectors_file("../cellular-frustration-model/output/pruned_detectors.csv");
+            exportVector(pruned_detectors_file, detectors_kept);
 
-            // Reset some of the agents' data structures
-            resetAgentsMatch(agents);
-            resetAgentsTau(agents);
-            resetAgentsTausMap(agents);
-        }
+            std::ofstream pruned_subtypes_file("../cellular-frustration-model/output/pruned_subtypes.csv");
+            exportVector(pruned_subtypes_file, std::vector<uint16_t>(agents.subtype.begin() + n_presenters, agents.subtype.end()));
 
-        // Activation threshold percentage used to select the reference number of pairings generated for all normal test samples
-        uint16_t const activation_threshold_percent = params["activation threshold percent"];
+            std::ofstream pruned_global_lists_file("../cellular-frustration-model/output/pruned_global_lists.csv");
+            std::ofstream pruned_left_criticals_file("../cellular-frustration-model/output/pruned_left_criticals.csv");
+            std::ofstream pruned_right_criticals_file("../cellular-frustration-model/output/pruned_right_criticals.csv");
+            for (uint16_t id = n_presenters; id < agents.id.size(); ++id) {
+                exportVector(pruned_global_lists_file, agents.global_list.at(id));
+                exportVector(pruned_left_criticals_file, std::vector<float>(agents.left_criticals.at(id).begin(), agents.left_criticals.at(id).end()));
+                exportVector(pruned_right_criticals_file, std::vector<float>(agents.right_criticals.at(id).begin(), agents.right_criticals.at(id).end()));
+            }
 
-        // Compute activation threshold for each detector
-        computeActivationThresholds(agents, n_presenters, number_pairings, activation_threshold_percent, n_normal_samples);
+            std::ofstream pruned_thresholds_file("../cellular-frustration-model/output/pruned_activation_thresholds.csv");
+            exportVector(pruned_thresholds_file, std::vector<uint32_t>(agents.activation_thresholds.begin() + n_presenters, agents.activation_thresholds.end()));
+        }
 
         // Responses for all test samples
         std::vector<uint32_t> responses(n_samples);
 
-        // Get responses from detectors towards normal and abnormal test samples
-        for (uint16_t i = 0; i < n_samples; ++i) {
-            monitoring(agents, n_presenters, monitoring_rounds, n_features, test_set.at(i));
+        if (online_calibration_flag) {
+            // Score test samples in order, moving the activation thresholds with each batch's normal samples past the calibration's
+            setMetricsPhase(workspace.metrics, METRICS_RESPONSES, n_samples);
+            OnlineCalibration online = initOnlineCalibration(normal_pairings, activation_threshold_percent, params["online half life"]);
+            scoreSamplesOnline(agents, workspace, n_presenters, monitoring_rounds, n_features, test_set, test_set_classes, activation_tau, signature_index, online, params["online batch"], responses, n_calibration, n_threads);
+
+            // Export each detector's final activation threshold
+            std::ofstream thresholds_file("../cellular-frustration-model/output/online_thresholds.csv");
+            exportVector(thresholds_file, std::vector<uint32_t>(agents.activation_thresholds.begin() + n_presenters, agents.activation_thresholds.end()));
+        } else {
+            // Maximum number of responses remembered across runs (0 disables the cache)
+            uint32_t const response_cache_size = params["response cache size"];
+
+            // Share cached responses between samples falling in the same critical intervals
+            bool const response_cache_quantize = params["response cache quantize"];
+
+            // Responses cache for repeated samples
+            ResponseCache response_cache = initResponseCache(agents, n_presenters, n_features, activation_tau, monitoring_rounds, workspace.fast_shuffle, response_cache_size, response_cache_quantize);
+            if (response_cache_size > 0) {
+                loadResponseCache("../cellular-frustration-model/output/response_cache.csv", response_cache);
+            }
+
+            // Test samples that need a simulation and their cache keys
+            std::vector<uint16_t> scored_samples;
+            std::vector<uint64_t> scored_samples_keys;
+            for (uint16_t i = 0; i < n_samples; ++i) {
+                // Equivalent samples share the same response
+                if (equivalent_samples.at(i) != i) {
+                    continue;
+                }
 
-            // Register the number of pairings for the activation tau
-            getNumberPairingsForActivationTau(agents, n_presenters, number_pairings, activation_tau);
+                // Skip the simulation of samples with a cached response
+                uint64_t const sample_key = computeSampleKey(response_cache, test_set.at(i));
+                if (lookupResponse(response_cache, sample_key, responses.at(i))) {
+                    continue;
+                }
+
+                scored_samples.push_back(i);
+                scored_samples_keys.push_back(sample_key);
+            }
 
-            // Compute response to sample
-            responses.at(i) = computeCollectiveResponse(agents, n_presenters, activation_tau);
+            setMetricsPhase(workspace.metrics, METRICS_RESPONSES, scored_samples.size());
 
-            // Reset some of the agents' data structures
-            resetAgentsMatch(agents);
-            resetAgentsTau(agents);
-            resetAgentsTausMap(agents);
+            // Number of worker processes used to score test samples (1 or less scores in this process)
+            uint16_t const scoring_processes = params["scoring processes"];
+
+            // Get responses from detectors towards normal and abnormal test samples
+            if (scoring_processes > 1) {
+                const std::vector<uint32_t> scored_responses = scoreSamplesSharded(agents, n_presenters, n_features, activation_tau, monitoring_rounds, workspace.fast_shuffle, test_set, scored_samples, workspace.metrics, scoring_processes);
+                for (uint16_t i = 0; i < scored_samples.size(); ++i) {
+                    responses.at(scored_samples.at(i)) = scored_responses.at(i);
+                }
+            } else {
+                scoreSamples(agents, workspace, n_presenters, monitoring_rounds, n_features, test_set, scored_samples, activation_tau, signature_index, responses, n_threads);
+            }
+
+            // Remember new responses and copy them to equivalent samples
+            for (uint16_t i = 0; i < scored_samples.size(); ++i) {
+                insertResponse(response_cache, scored_samples_keys.at(i), responses.at(scored_samples.at(i)));
+            }
+            for (uint16_t i = 0; i < n_samples; ++i) {
+                responses.at(i) = responses.at(equivalent_samples.at(i));
+            }
+
+            // Persist cached responses for the next run
+            if (response_cache_size > 0) {
+                std::ofstream response_cache_file("../cellular-frustration-model/output/response_cache.csv");
+                exportResponseCache(response_cache_file, response_cache);
+            }
         }
 
         // File used to write all the responses to test samples
@@ -234,7 +431,26 @@ int main()
 
         // Export responses to test samples
         exportVector(responses_file, responses);
+
+        if (memory_report_flag) {
+            recordAgentsMemory(memory_report, agents, "monitoring");
+        }
     }
 
+    // Last export of the live metrics
+    stopMetricsReporter(live_metrics);
+    workspace.metrics = nullptr;
+
+    // Export the memory report
+    if (memory_report_flag) {
+        std::ofstream memory_report_file("../cellular-frustration-model/output/memory.csv");
+        exportMemoryReport(memory_report_file, memory_report);
+    }
+
+#ifdef CFM_COUNT_ALLOCATIONS
+    // Report heap allocations inside the simulation loops
+    std::cout << "Hot path allocations: " << workspace.hot_path_allocations << " over " << workspace.calls << " calls, " << workspace.last_call_allocations << " in the last call" << '\n';
+#endif
+
     return 0;
 }
@@ -0,0 +1,101 @@
+#include "../include/trace.h"
+
+using namespace cfm;
+
+// Read an unsigned value written by putTraceValue, return false at the end of the file
+bool getTraceValue(FILE* file, bool const& compressed, uint64_t& value)
+{
+    value = 0;
+
+    // LEB128 varint
+    if (compressed) {
+        for (uint16_t shift = 0; shift < 64; shift += 7) {
+            int byte = std::fgetc(file);
+            if (byte == EOF) {
+                return false;
+            }
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Little-endian 32-bit value
+    for (uint16_t i = 0; i < 4; ++i) {
+        int byte = std::fgetc(file);
+        if (byte == EOF) {
+            return false;
+        }
+        value |= (uint64_t)byte << (8 * i);
+    }
+
+    return true;
+}
+
+// Convert a binary trace into a taus CSV file and a rounds CSV file
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " trace.bin [output prefix]" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    std::string const trace_path = argv[1];
+    std::string const prefix = argc > 2 ? argv[2] : trace_path.substr(0, trace_path.rfind('.'));
+
+    FILE* file = std::fopen(trace_path.c_str(), "rb");
+    if (file == nullptr) {
+        std::cout << "Error opening file" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    // Check header
+    char header[6];
+    if (std::fread(header, 1, sizeof(header), file) != sizeof(header) || std::string(header, 4) != "CFMT" || header[4] != (char)TRACE_VERSION) {
+        std::cout << "Not a trace file" << '\n';
+        return EXIT_FAILURE;
+    }
+    bool const compressed = header[5] & TRACE_FLAG_COMPRESSED;
+
+    std::ofstream taus_file(prefix + "_taus.csv");
+    std::ofstream rounds_file(prefix + "_rounds.csv");
+    taus_file << "phase,agent,tau,count" << '\n';
+    rounds_file << "phase,round,pairs,dissociations,educations" << '\n';
+
+    // Read records
+    int type;
+    while ((type = std::fgetc(file)) != EOF) {
+        uint64_t phase, agent, n_entries, tau, count, round, pairs, dissociations, educations;
+
+        if (type == TRACE_TAUS_MAP) {
+            if (!getTraceValue(file, compressed, phase) || !getTraceValue(file, compressed, agent) || !getTraceValue(file, compressed, n_entries)) {
+                break;
+            }
+            uint64_t previous_tau = 0;
+            for (uint64_t i = 0; i < n_entries; ++i) {
+                if (!getTraceValue(file, compressed, tau) || !getTraceValue(file, compressed, count)) {
+                    break;
+                }
+                if (compressed) {
+                    tau += previous_tau;
+                    previous_tau = tau;
+                }
+                taus_file << phase << ',' << agent << ',' << tau << ',' << count << '\n';
+            }
+        } else if (type == TRACE_ROUND) {
+            if (!getTraceValue(file, compressed, phase) || !getTraceValue(file, compressed, round) || !getTraceValue(file, compressed, pairs) || !getTraceValue(file, compressed, dissociations) || !getTraceValue(file, compressed, educations)) {
+                break;
+            }
+            rounds_file << phase << ',' << round << ',' << pairs << ',' << dissociations << ',' << educations << '\n';
+        } else {
+            std::cout << "Unknown trace record" << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::fclose(file);
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "../include/workload.h"
+
+using namespace cfm;
+
+// Set a workload parameter from a key=value argument, return false for an unknown key
+bool setWorkloadParameter(WorkloadParameters& parameters, std::string const& key, std::string const& value)
+{
+    if (key == "seed") {
+        parameters.seed = std::stoull(value);
+    } else if (key == "features") {
+        parameters.n_features = std::stoul(value);
+    } else if (key == "clusters") {
+        parameters.n_clusters = std::stoul(value);
+    } else if (key == "training") {
+        parameters.n_training = std::stoul(value);
+    } else if (key == "test") {
+        parameters.n_test = std::stoul(value);
+    } else if (key == "anomaly-percent") {
+        parameters.anomaly_percent = std::stod(value);
+    } else if (key == "spread") {
+        parameters.spread = std::stod(value);
+    } else if (key == "shift") {
+        parameters.shift = std::stod(value);
+    } else if (key == "anomalous-features") {
+        parameters.n_anomalous_features = std::stoul(value);
+    } else if (key == "lists") {
+        parameters.lists = std::stoul(value) != 0;
+    } else if (key == "presenters-sets") {
+        parameters.n_presenters_sets = std::stoul(value);
+    } else if (key == "max-nu") {
+        parameters.max_nu = std::stod(value);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+// Write a synthetic data set and its accompanying files into a folder
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::cout << "Usage: " << argv[0] << " output_folder [key=value ...]" << '\n';
+        std::cout << "Keys: seed, features, clusters, training, test, anomaly-percent, spread, shift, anomalous-features, lists, presenters-sets, max-nu" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    std::string output_path = argv[1];
+    if (output_path.back() != '/') {
+        output_path += '/';
+    }
+
+    WorkloadParameters parameters;
+    for (int i = 2; i < argc; ++i) {
+        std::string const argument = argv[i];
+        std::size_t const separator = argument.find('=');
+        if (separator == std::string::npos || !setWorkloadParameter(parameters, argument.substr(0, separator), argument.substr(separator + 1))) {
+            std::cout << "Unknown argument " << argument << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Samples are indexed with 16 bits by the model, and agents' partners with signed 16 bits
+    if (parameters.n_features == 0 || parameters.n_clusters == 0 || parameters.n_training == 0 || parameters.n_presenters_sets == 0
+        || parameters.n_training > UINT16_MAX || parameters.n_test > UINT16_MAX
+        || 2 * (uint32_t)parameters.n_features * parameters.n_presenters_sets > INT16_MAX
+        || parameters.n_anomalous_features > parameters.n_features
+        || parameters.anomaly_percent < 0 || parameters.anomaly_percent > 100) {
+        std::cout << "Invalid workload parameters" << '\n';
+        return EXIT_FAILURE;
+    }
+
+    generateWorkload(parameters, output_path);
+
+    return EXIT_SUCCESS;
+}